@@ -0,0 +1,216 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+#include <functional>
+#include <string>
+#include <vector>
+#include "../integrate.h"
+
+/* Integrands of increasing cost. flops is a nominal count per evaluation, with a call to
+ * std::exp or std::sin counted as 20; it is only used to turn the timings into GFLOP/s. */
+double cheap(double x) { return x*x + 1.0; }
+double exponential(double x) { return std::exp(x); }
+double costly(double x) {
+    double sum = 0.0;
+    for (int k = 1; k <= 8; ++k)
+        sum += std::sin(k*x);
+    return sum;
+}
+
+struct integrand_info {
+    const char *name;
+    integrate::integrand_fptr_t fptr;
+    double flops;
+};
+const std::array<integrand_info, 3> integrands = {{
+    {"cheap", &cheap, 2.0},
+    {"exp", &exponential, 20.0},
+    {"sin8", &costly, 8*22.0},
+}};
+
+// Nominal flops per point spent by the rule itself: the abscissa and the weighted add
+constexpr double rule_flops = 4.0;
+
+// Don't let the compiler drop the integrations
+volatile double sink;
+
+struct result {
+    std::string method, callable, integrand;
+    int meshsize, threads;
+    long repeats;
+    double ns_per_eval, gflops;
+};
+
+struct timing {
+    double ns;      // best time per call
+    long repeats;
+};
+
+/* Time integrate(meshsize) repeatedly for at least min_time seconds, after one warm-up call that
+ * also fills the Legendre cache. */
+template<class Method>
+timing time_method(Method integrate, int meshsize, double min_time) {
+    using clock = std::chrono::steady_clock;
+
+    sink = integrate(meshsize);
+
+    timing t = {HUGE_VAL, 0};
+    double total = 0.0;
+    while (total < min_time*1e9) {
+        const auto start = clock::now();
+        sink = integrate(meshsize);
+        const double ns = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+        t.ns = std::min(t.ns, ns);
+        total += ns;
+        ++t.repeats;
+    }
+
+    return t;
+}
+
+/* Number of points a composite rule of panels of panel intervals evaluates for meshsize: as in
+ * newton_cotes, meshsize-1 is rounded up to a nonzero multiple of panel. */
+long rule_points(int meshsize, int panel) {
+    const long intervals = std::max(meshsize - 1, 1);
+    return (intervals + panel - 1)/panel*panel + 1;
+}
+
+/* Benchmark method on each integrand through each callable type: std::function, function
+ * pointer, and a lambda the compiler can inline into the rule. points is the number of
+ * evaluations the rule makes for meshsize, which the per-evaluation figures are based on. */
+template<class Method>
+void bench_method(std::vector<result> &results, const char *name, Method method, int meshsize,
+                  long points, int threads, double min_time)
+{
+    for (auto &&info: integrands) {
+        const integrate::integrand_t func = info.fptr;
+        const integrate::integrand_fptr_t fptr = info.fptr;
+
+        auto run = [&](const char *callable, timing t) {
+            const double evals = points;
+            results.push_back({
+                name, callable, info.name, meshsize, threads, t.repeats,
+                t.ns/evals, evals*(info.flops + rule_flops)/t.ns
+            });
+        };
+
+        run("integrand_t", time_method([&](int n) { return method(n, func); },
+                                       meshsize, min_time));
+        run("integrand_fptr_t", time_method([&](int n) { return method(n, fptr); },
+                                            meshsize, min_time));
+        // Each lambda is a distinct type, so each integrand needs its own case
+        switch (&info - integrands.data()) {
+            case 0:
+                run("lambda", time_method([&](int n) {
+                    return method(n, [](double x) { return cheap(x); });
+                }, meshsize, min_time));
+                break;
+            case 1:
+                run("lambda", time_method([&](int n) {
+                    return method(n, [](double x) { return exponential(x); });
+                }, meshsize, min_time));
+                break;
+            case 2:
+                run("lambda", time_method([&](int n) {
+                    return method(n, [](double x) { return costly(x); });
+                }, meshsize, min_time));
+                break;
+        }
+    }
+}
+
+void write_csv(std::ostream &stream, const std::vector<result> &results) {
+    stream << "method,callable,integrand,meshsize,threads,repeats,ns_per_eval,gflops\n";
+    stream << std::setprecision(6);
+    for (auto &&r: results) {
+        stream << r.method << ',' << r.callable << ',' << r.integrand << ',' << r.meshsize << ','
+               << r.threads << ',' << r.repeats << ',' << r.ns_per_eval << ',' << r.gflops
+               << '\n';
+    }
+}
+
+void write_json(std::ostream &stream, const std::vector<result> &results) {
+    stream << "[\n" << std::setprecision(6);
+    for (size_t i = 0; i < results.size(); ++i) {
+        auto &&r = results[i];
+        stream << "  {\"method\": \"" << r.method << "\", \"callable\": \"" << r.callable
+               << "\", \"integrand\": \"" << r.integrand << "\", \"meshsize\": " << r.meshsize
+               << ", \"threads\": " << r.threads << ", \"repeats\": " << r.repeats
+               << ", \"ns_per_eval\": " << r.ns_per_eval << ", \"gflops\": " << r.gflops << '}'
+               << (i+1 < results.size() ? ",\n" : "\n");
+    }
+    stream << "]\n";
+}
+
+void write_usage(std::ostream &stream, const char *program) {
+    stream << "Usage: " << program << " [--json] [--min-time <seconds>]"
+           << " [--max-meshsize <n>] [<threads>...]\n"
+           << "  --json               print JSON instead of CSV\n"
+           << "  --min-time <seconds> minimum time to spend on each timing (default 0.2)\n"
+           << "  --max-meshsize <n>   largest meshsize to time (default 10000000)\n"
+           << "  <threads>...         thread counts to run with (default: OMP_NUM_THREADS)\n";
+}
+
+int main(int argc, char **argv) {
+    bool json = false;
+    double min_time = 0.2;
+    int max_meshsize = 10000000;
+    std::vector<int> thread_counts;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--help") == 0) {
+            write_usage(std::cout, argv[0]);
+            return 0;
+        }
+        else if (std::strcmp(argv[i], "--json") == 0)
+            json = true;
+        else if (std::strcmp(argv[i], "--min-time") == 0 && i+1 < argc)
+            min_time = std::stod(argv[++i]);
+        else if (std::strcmp(argv[i], "--max-meshsize") == 0 && i+1 < argc)
+            max_meshsize = std::stoi(argv[++i]);
+        else if (argv[i][0] != '-')
+            thread_counts.push_back(std::stoi(argv[i]));
+        else {
+            write_usage(std::cerr, argv[0]);
+            return 1;
+        }
+    }
+    if (thread_counts.empty())
+        thread_counts.push_back(0);
+
+    // Legendre's nodes cost O(meshsize^2) to compute once, so it stops at a smaller meshsize
+    constexpr int legendre_max_meshsize = 10000;
+
+    std::vector<result> results;
+    for (int threads: thread_counts) {
+        integrate::set_threads(threads);
+        const int nthreads = integrate::threads();
+
+        // long, so that stepping past a max_meshsize near INT_MAX doesn't overflow
+        for (long meshsize = 1000; meshsize <= max_meshsize; meshsize *= 100) {
+            bench_method(results, "simpson", [](int n, auto f) {
+                return integrate::simpson(0.0, 1.0, n, f);
+            }, int(meshsize), rule_points(int(meshsize), 2), nthreads, min_time);
+            bench_method(results, "milne", [](int n, auto f) {
+                return integrate::milne(0.0, 1.0, n, f);
+            }, int(meshsize), rule_points(int(meshsize), 4), nthreads, min_time);
+        }
+    }
+    for (int meshsize = 10; meshsize <= std::min(max_meshsize, legendre_max_meshsize);
+         meshsize *= 10)
+    {
+        bench_method(results, "legendre", [](int n, auto f) {
+            return integrate::legendre(0.0, 1.0, n, f);
+        }, meshsize, meshsize, 1, min_time);
+    }
+
+    if (json)
+        write_json(std::cout, results);
+    else
+        write_csv(std::cout, results);
+
+    return 0;
+}
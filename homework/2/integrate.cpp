@@ -1,140 +1,721 @@
 #include <stdexcept>
+#include <cmath>
 #include <functional>
-#include <iostream>
+#include <algorithm>
 #include <cstdlib>
-#include <gsl/gsl_integration.h>
+#include <vector>
+#include <map>
+#include <mutex>
+#ifdef OMP
+    #include <omp.h>
+#endif
 #include "integrate.h"
 
 namespace integrate {
 
-/* The use of OpenMP in simpson and milne does not seem to produce any speedup
- * on my 4-core machine; however, I only ever see 100% CPU usage, so there is
- * possibly something going on.  */
+/* With OMP defined, simpson and milne split the mesh into fixed stripes of points which are
+ * statically distributed over the threads. Each stripe's sum is stored separately and the
+ * stripes are then summed pairwise in a fixed order, so the result is bit-for-bit the same for
+ * any number of threads (including a build without OpenMP). The integrand must therefore be
+ * safe to call concurrently. */
+
+// Number of threads requested with set_threads(); 0 means the OpenMP default.
+static int requested_threads = 0;
 
+void set_threads(int nthreads) {
+    if (nthreads < 0)
+        throw std::domain_error("nthreads must be nonnegative");
+    requested_threads = nthreads;
+}
+
+int threads() {
+    #ifdef OMP
+    return requested_threads > 0 ? requested_threads : omp_get_max_threads();
+    #else
+    return 1;
+    #endif
+}
 
 // NOTE: meshsize-1 is the number of intervals corresponding to a given meshsize
 
-/* Calculate the composite Simpson's rule for func(x) between x=begin and x=end on at least
- * meashsize points.
- *
- * Quadrature weights: step_size/3*(1, 4, 1)
+namespace detail {
+
+/* Adapts a pointwise integrand to the batch interface. Since this is a template rather than a
+ * std::function, a lambda or function passed to simpson/milne gets inlined into the loop over
+ * the block. */
+template<class F> struct pointwise {
+    F &func;
+
+    void operator()(const double *xs, double *ys, int n) const {
+        for (int k = 0; k < n; ++k)
+            ys[k] = func(xs[k]);
+    }
+};
+
+/* Sum of w[k]*y[k] for k = 0...n-1 with four independent accumulators, so the compiler can keep
+ * them in one vector register without reassociating the additions itself. */
+template<class Acc> double weighted_sum(const double *w, const double *y, int n) {
+    Acc acc[4];
+    int k = 0;
+    for (; k + 4 <= n; k += 4) {
+        for (int j = 0; j < 4; ++j)
+            acc[j].add(w[k+j]*y[k+j]);
+    }
+    for (; k < n; ++k)
+        acc[0].add(w[k]*y[k]);
+
+    Acc total;
+    for (int j = 0; j < 4; ++j)
+        total.add(acc[j].result());
+    return total.result();
+}
+
+// Sum of the block sums x[k] for k = 0...n-1, in an order that only depends on n.
+template<class Acc> double reduce(const double *x, int n) {
+    Acc total;
+    for (int k = 0; k < n; ++k)
+        total.add(x[k]);
+    return total.result();
+}
+
+// By recursive halving, so rounding error grows like log(n).
+template<> inline double reduce<pairwise_sum>(const double *x, int n) {
+    if (n <= 8)
+        return reduce<naive_sum>(x, n);
+    const int half = n/2;
+    return reduce<pairwise_sum>(x, half) + reduce<pairwise_sum>(x + half, n - half);
+}
+
+/* Sum of w[k]*term(k) for k = 0...n-1 (w == nullptr meaning all ones) in blocks of batch_size,
+ * as described for the accumulator policies. */
+template<class Acc, class T> double blocked_sum(const double *w, int n, T term) {
+    static const std::vector<double> ones(batch_size, 1.0);
+
+    std::vector<double> partials;
+    partials.reserve((n + batch_size - 1)/batch_size);
+    double ys[batch_size];
+    for (int base = 0; base < n; base += batch_size) {
+        const int m = std::min(batch_size, n - base);
+        for (int k = 0; k < m; ++k)
+            ys[k] = term(base + k);
+        partials.push_back(weighted_sum<Acc>(w ? w + base : ones.data(), ys, m));
+    }
+
+    return reduce<Acc>(partials.data(), int(partials.size()));
+}
+
+// Round meshsize-1 up to the nearest nonzero multiple of period
+inline int fix_meshsize(int meshsize, int period) {
+    if (meshsize == 1)
+        return period + 1;
+    else if ((meshsize-1) % period != 0)
+        return meshsize + period - (meshsize-1) % period;
+    return meshsize;
+}
+
+/* Weighted sum of a batch integrand over the meshsize points begin + i*step, the last of which
+ * is end, for a composite closed rule whose panels are Period intervals wide.
  *
- * meshsize-1 is rounded up to the nearest multiple of two. A meshsize < 0 throws an
- * std::domain_error, and meshsize == 0 is guaranteed to return 0.0.
+ * The point i gets weight pattern[i % Period], except for the two end points which get
+ * end_weight; pattern[0] is thus the doubled weight of a point shared by two panels.
+ * Points are handed to func in blocks whose length is a multiple of Period, so a single
+ * precomputed tile of weights lines up with every block and no weight is looked up per point.
  */
-template<class F> double simpson(double begin, double end, int meshsize, F func) {
-    if (meshsize < 0)
-        throw std::domain_error("meshsize must be positive");
-    else if (meshsize == 0)
-        return 0.0;
-
-    // Fix meshsize
-    if ((meshsize-1) % 2 != 0)
-        meshsize += 2 - (meshsize-1)%2;
+template<int Period, class Acc, class B>
+double composite_sum(double begin, double end, double step, int meshsize,
+                     const double (&pattern)[Period], double end_weight, B &func)
+{
+    constexpr int block = batch_size/Period*Period;
+    static_assert(block > 0, "batch_size must be at least one panel");
 
-    double step = (end-begin)/(meshsize-1);
+    double tile[block];
+    for (int k = 0; k < block; ++k)
+        tile[k] = pattern[k % Period];
 
-    // First point gets first weight = 1
-    double integral = func(begin);
+    // Each block is one stripe of the parallel loop
+    const int nblocks = (meshsize + block - 1)/block;
+    std::vector<double> partials(nblocks);
+    double first = 0.0, last = 0.0;
     #ifdef OMP
-    #pragma omp parallel for reduction(+:integral)
+    #pragma omp parallel for schedule(static) num_threads(threads())
     #endif
-    for (int i = 1; i < meshsize-1; ++i) {
-        const double x = begin + i*step;
-        // Summing over multiple intervals; ends overlap, giving double weight (2*1 = 2)
-        integral += (i % 2 == 0 ? 2.0 : 4.0)*func(x);
-    }
-    // Last point gets last weight = 1
-    integral += func(end);
-    
-    // Remaining factors out front
-    return step/3.0*integral;
+    for (int b = 0; b < nblocks; ++b) {
+        const int base = b*block;
+        const int n = std::min(block, meshsize - base);
+
+        double xs[block], ys[block];
+        for (int k = 0; k < n; ++k)
+            xs[k] = begin + (base + k)*step;
+        if (b == nblocks-1)
+            xs[n-1] = end;
+
+        func(static_cast<const double *>(xs), static_cast<double *>(ys), n);
+        partials[b] = weighted_sum<Acc>(tile, ys, n);
+
+        if (b == 0)
+            first = ys[0];
+        if (b == nblocks-1)
+            last = ys[n-1];
+    }
+    const double integral = reduce<Acc>(partials.data(), nblocks);
+
+    // The end points belong to only one panel
+    return integral + (end_weight - pattern[0])*(first + last);
 }
 
-/* Calculate the composite Milne's rule for func(x) between x=begin and x=end on at least
- * meshsize points.
+} // end namespace detail
+
+namespace detail {
+
+/* Weights of the points within one panel of newton_cotes<Intervals>, as used by composite_sum:
+ * the first point is shared with the previous panel and so gets double weight. Computed at
+ * compile time from the rule's table. */
+template<int Intervals> struct panel_pattern {
+    double weights[Intervals];
+
+    constexpr panel_pattern() : weights() {
+        weights[0] = 2.0*newton_cotes_rule<Intervals>::weights[0];
+        for (int k = 1; k < Intervals; ++k)
+            weights[k] = newton_cotes_rule<Intervals>::weights[k];
+    }
+};
+
+} // end namespace detail
+
+/* Calculate the composite closed Newton-Cotes rule with panels of Intervals intervals for
+ * func(x) between x=begin and x=end on at least meshsize points.
  *
- * Quadrature weights: step_size/45*(14, 64, 24, 64, 14)
+ * Quadrature weights: step_size*newton_cotes_rule<Intervals>::scale*weights
  *
- * meshsize-1 is rounded up to the nearest multiple of 4. A meshsize < 0 throws an
+ * meshsize-1 is rounded up to the nearest nonzero multiple of Intervals. A meshsize < 0 throws an
  * std::domain_error, and meshsize == 0 is guaranteed to return 0.0.
  */
-template<class F> double milne(double begin, double end, int meshsize, F func) {
+template<int Intervals, class F, class Acc>
+double newton_cotes(double begin, double end, int meshsize, F func) {
+    return newton_cotes_batch<Intervals, detail::pointwise<F>, Acc>(
+        begin, end, meshsize, detail::pointwise<F>{func}
+    );
+}
+
+template<int Intervals, class B, class Acc>
+double newton_cotes_batch(double begin, double end, int meshsize, B func) {
+    using rule = newton_cotes_rule<Intervals>;
+    static constexpr detail::panel_pattern<Intervals> pattern;
+
     if (meshsize < 0)
         throw std::domain_error("meshsize must be positive");
     else if (meshsize == 0)
         return 0.0;
 
-    // Fix meshsize
-    if ((meshsize-1) % 4 != 0)
-        meshsize += 4 - (meshsize-1) % 4;
+    meshsize = detail::fix_meshsize(meshsize, Intervals);
+    const double step = (end - begin)/(meshsize-1);
+
+    // Summing over multiple panels; ends overlap, giving double weight
+    const double integral = detail::composite_sum<Intervals, Acc>(
+        begin, end, step, meshsize, pattern.weights, rule::weights[0], func
+    );
 
+    // Remaining factors out front
+    return step*rule::scale*integral;
+}
+
+/* Nodes and weights on [begin, end] of newton_cotes<Intervals>, for use with batch(). The same
+ * meshsize rules apply. */
+template<int Intervals>
+node_set newton_cotes_nodes(double begin, double end, int meshsize) {
+    using rule = newton_cotes_rule<Intervals>;
+    static constexpr detail::panel_pattern<Intervals> pattern;
+
+    node_set nodes;
+    if (meshsize < 0)
+        throw std::domain_error("meshsize must be positive");
+    else if (meshsize == 0)
+        return nodes;
+
+    meshsize = detail::fix_meshsize(meshsize, Intervals);
     const double step = (end - begin)/(meshsize-1);
 
-    // First point gets first weight
-    double integral = 14*func(begin);
-    double mid_integral = 0.0;
-    #ifdef OMP
-    #pragma omp parallel for reduction(+:mid_integral)
-    #endif
-    for (int i = 1; i < meshsize-1; ++i) {
-        const double x = begin + i*step;
-        int weight;
-        // Summing over multiple intervals; ends overlap, giving double weight (2*14)
-        switch (i % 4) {
-            case 0: weight = 2*14; break;
-            case 1: weight = 64;  break;
-            case 2: weight = 24;  break;
-            case 3: weight = 64;  break;
+    nodes.nodes.resize(meshsize);
+    nodes.weights.resize(meshsize);
+    for (int i = 0; i < meshsize; ++i) {
+        nodes.nodes[i] = begin + i*step;
+        nodes.weights[i] = step*rule::scale*pattern.weights[i % Intervals];
+    }
+    nodes.nodes.back() = end;
+    nodes.weights.front() = nodes.weights.back() = step*rule::scale*rule::weights[0];
+
+    return nodes;
+}
+
+// Simpson's and Milne's rules are the 2 and 4 interval Newton-Cotes rules.
+template<class F, class Acc> double simpson(double begin, double end, int meshsize, F func) {
+    return newton_cotes<2, F, Acc>(begin, end, meshsize, func);
+}
+
+template<class F, class Acc> double milne(double begin, double end, int meshsize, F func) {
+    return newton_cotes<4, F, Acc>(begin, end, meshsize, func);
+}
+
+template<class B, class Acc> double simpson_batch(double begin, double end, int meshsize, B func) {
+    return newton_cotes_batch<2, B, Acc>(begin, end, meshsize, func);
+}
+
+template<class B, class Acc> double milne_batch(double begin, double end, int meshsize, B func) {
+    return newton_cotes_batch<4, B, Acc>(begin, end, meshsize, func);
+}
+
+node_set simpson_nodes(double begin, double end, int meshsize) {
+    return newton_cotes_nodes<2>(begin, end, meshsize);
+}
+
+node_set milne_nodes(double begin, double end, int meshsize) {
+    return newton_cotes_nodes<4>(begin, end, meshsize);
+}
+
+node_set legendre_nodes(double begin, double end, int meshsize) {
+    node_set rule;
+    if (meshsize < 0)
+        throw std::domain_error("meshsize must be positive");
+    else if (meshsize == 0)
+        return rule;
+
+    const legendre_rule &legendre = *legendre_rule::get(meshsize);
+    const double mid = (end + begin)/2.0;
+    const double half = (end - begin)/2.0;
+    rule.nodes.resize(meshsize);
+    rule.weights.resize(meshsize);
+    for (int k = 0; k < meshsize; ++k) {
+        rule.nodes[k] = mid + half*legendre.nodes()[k];
+        rule.weights[k] = half*legendre.weights()[k];
+    }
+
+    return rule;
+}
+
+/* Integrate nfuncs integrands on the nodes of rule at once.
+ *
+ * The values are gathered node-major into a batch_size x nfuncs block, which is then reduced
+ * against that block's weights as a matrix-vector product. The inner loop runs over the
+ * integrands, which are contiguous, so it is a vectorizable axpy per node, and each block stays
+ * in cache between being filled and being reduced.
+ */
+template<class F> void batch(const node_set &rule, int nfuncs, F func, double *out) {
+    if (nfuncs < 0)
+        throw std::domain_error("nfuncs must be nonnegative");
+    std::fill(out, out + nfuncs, 0.0);
+
+    const int nnodes = int(rule.nodes.size());
+    std::vector<double> values(size_t(batch_size)*nfuncs);
+    for (int base = 0; base < nnodes; base += batch_size) {
+        const int n = std::min(batch_size, nnodes - base);
+
+        for (int k = 0; k < n; ++k)
+            func(rule.nodes[base+k], &values[size_t(k)*nfuncs]);
+
+        for (int k = 0; k < n; ++k) {
+            const double w = rule.weights[base+k];
+            const double *row = &values[size_t(k)*nfuncs];
+            for (int j = 0; j < nfuncs; ++j)
+                out[j] += w*row[j];
         }
-        mid_integral += weight*func(x);
     }
-    // Last point gets last weight
-    integral += mid_integral + 14*func(end);
+}
 
-    // Remaining factors out front
-    return step*integral/45.0;
+void batch(const node_set &rule, const std::vector<integrand_t> &funcs, double *out) {
+    batch(rule, int(funcs.size()), [&funcs](double x, double *values) {
+        for (size_t j = 0; j < funcs.size(); ++j)
+            values[j] = funcs[j](x);
+    }, out);
+}
+
+namespace detail {
+
+/* A subinterval [a, b] of adaptive_simpson with the integrand at its quarter points. coarse is
+ * Simpson's rule on [a, b] and fine is Simpson's rule on its two halves; the error of fine is
+ * then about (fine - coarse)/15. */
+struct adaptive_panel {
+    double a, b;
+    double f[5];
+    double coarse, fine, error;
+
+    adaptive_panel(double a, double b, const double (&f_)[5]) : a(a), b(b) {
+        std::copy(f_, f_ + 5, f);
+        const double h = b - a;
+        coarse = h/6.0*(f[0] + 4.0*f[2] + f[4]);
+        fine = h/12.0*(f[0] + 4.0*f[1] + 2.0*f[2] + 4.0*f[3] + f[4]);
+        error = std::abs(fine - coarse)/15.0;
+    }
+
+    // Richardson extrapolated value
+    double value() const { return fine + (fine - coarse)/15.0; }
+
+    // For the max-heap on error
+    bool operator<(const adaptive_panel &other) const { return error < other.error; }
+};
+
+} // end namespace detail
+
+template<class F> adaptive_result adaptive_simpson(double begin, double end, double abs_tol,
+                                                   double rel_tol, int max_evals, F func)
+{
+    if (max_evals < 5)
+        throw std::domain_error("max_evals must be at least 5");
+
+    std::vector<detail::adaptive_panel> heap;
+    {
+        const double h = end - begin;
+        const double f[5] = {
+            func(begin), func(begin + h/4.0), func(begin + h/2.0), func(end - h/4.0), func(end)
+        };
+        heap.emplace_back(begin, end, f);
+    }
+    int evaluations = 5;
+    double value = heap.front().value();
+    double error = heap.front().error;
+
+    while (error > std::max(abs_tol, rel_tol*std::abs(value)) && evaluations + 4 <= max_evals) {
+        std::pop_heap(heap.begin(), heap.end());
+        const detail::adaptive_panel panel = heap.back();
+        heap.pop_back();
+
+        const double h = panel.b - panel.a;
+        const double m = (panel.a + panel.b)/2.0;
+        // Give up once the panel can't be split any further in floating point
+        if (panel.a + h/8.0 == panel.a) {
+            heap.push_back(panel);
+            std::push_heap(heap.begin(), heap.end());
+            break;
+        }
+
+        const double left_f[5] = {
+            panel.f[0], func(panel.a + h/8.0), panel.f[1], func(m - h/8.0), panel.f[2]
+        };
+        const double right_f[5] = {
+            panel.f[2], func(m + h/8.0), panel.f[3], func(panel.b - h/8.0), panel.f[4]
+        };
+        evaluations += 4;
+
+        const detail::adaptive_panel left(panel.a, m, left_f), right(m, panel.b, right_f);
+        value += left.value() + right.value() - panel.value();
+        error += left.error + right.error - panel.error;
+
+        heap.push_back(left);
+        std::push_heap(heap.begin(), heap.end());
+        heap.push_back(right);
+        std::push_heap(heap.begin(), heap.end());
+    }
+
+    // Sum up from scratch; the running totals above only steer the refinement
+    value = error = 0.0;
+    for (auto &&panel: heap) {
+        value += panel.value();
+        error += panel.error;
+    }
+
+    return {value, error, evaluations};
+}
+
+template<class F, class Acc>
+romberg<F, Acc>::romberg(double begin, double end, int intervals, F func)
+    : begin_(begin), end_(end), intervals_(intervals), func_(func), evaluations_(0)
+{
+    if (intervals < 1)
+        throw std::domain_error("intervals must be positive");
+
+    const double step = (end - begin)/intervals;
+    sum_.add((func_(begin) + func_(end))/2.0);
+    sum_.add(detail::blocked_sum<Acc>(nullptr, intervals - 1, [&](int i) {
+        return func_(begin + (i + 1)*step);
+    }));
+    evaluations_ = intervals + 1;
+
+    table_.push_back({step*sum_.result()});
+}
+
+template<class F, class Acc> void romberg<F, Acc>::refine() {
+    const double step = (end_ - begin_)/intervals_;
+
+    // The new points are the midpoints of the current intervals
+    sum_.add(detail::blocked_sum<Acc>(nullptr, intervals_, [&](int i) {
+        return func_(begin_ + (i + 0.5)*step);
+    }));
+    evaluations_ += intervals_;
+    intervals_ *= 2;
+
+    // R(k, j) = R(k, j-1) + (R(k, j-1) - R(k-1, j-1))/(4^j - 1)
+    const std::vector<double> &prev = table_.back();
+    std::vector<double> row(prev.size() + 1);
+    row[0] = step/2.0*sum_.result();
+    double factor = 1.0;
+    for (size_t j = 1; j < row.size(); ++j) {
+        factor *= 4.0;
+        row[j] = row[j-1] + (row[j-1] - prev[j-1])/(factor - 1.0);
+    }
+    table_.push_back(std::move(row));
 }
 
-/* Interface with GSL fixed Legendre method. Calculate integral of func(x) between x=begin and
- * x=end on meshisze points. 
+template<class F, class Acc> double romberg<F, Acc>::column(int j) const {
+    if (j >= levels())
+        throw std::logic_error("romberg: not refined enough for this rule");
+    return table_.back()[j];
+}
+
+// Infinite until there are two columns to compare
+template<class F, class Acc> double romberg<F, Acc>::error() const {
+    const std::vector<double> &row = table_.back();
+    if (row.size() < 2)
+        return HUGE_VAL;
+    return std::abs(row[row.size()-1] - row[row.size()-2]);
+}
+
+namespace detail {
+
+struct node_weight {
+    double node;
+    double weight;
+};
+
+/* Gauss-Legendre nodes on [-1, 1] in ascending order with their weights for n = 1...10 points;
+ * the rule for n points starts at index n*(n-1)/2. */
+constexpr int legendre_table_max = 10;
+constexpr node_weight legendre_table[] = {
+    // n = 1
+    { 0.00000000000000000e+00, 2.00000000000000000e+00},
+    // n = 2
+    {-5.77350269189625731e-01, 1.00000000000000000e+00},
+    { 5.77350269189625731e-01, 1.00000000000000000e+00},
+    // n = 3
+    {-7.74596669241483404e-01, 5.55555555555555580e-01},
+    { 0.00000000000000000e+00, 8.88888888888888840e-01},
+    { 7.74596669241483404e-01, 5.55555555555555580e-01},
+    // n = 4
+    {-8.61136311594052573e-01, 3.47854845137453850e-01},
+    {-3.39981043584856257e-01, 6.52145154862546095e-01},
+    { 3.39981043584856257e-01, 6.52145154862546095e-01},
+    { 8.61136311594052573e-01, 3.47854845137453850e-01},
+    // n = 5
+    {-9.06179845938663964e-01, 2.36926885056189085e-01},
+    {-5.38469310105683108e-01, 4.78628670499366471e-01},
+    { 0.00000000000000000e+00, 5.68888888888888888e-01},
+    { 5.38469310105683108e-01, 4.78628670499366471e-01},
+    { 9.06179845938663964e-01, 2.36926885056189085e-01},
+    // n = 6
+    {-9.32469514203152050e-01, 1.71324492379170357e-01},
+    {-6.61209386466264482e-01, 3.60761573048138606e-01},
+    {-2.38619186083196905e-01, 4.67913934572691037e-01},
+    { 2.38619186083196905e-01, 4.67913934572691037e-01},
+    { 6.61209386466264482e-01, 3.60761573048138606e-01},
+    { 9.32469514203152050e-01, 1.71324492379170357e-01},
+    // n = 7
+    {-9.49107912342758486e-01, 1.29484966168869703e-01},
+    {-7.41531185599394460e-01, 2.79705391489276645e-01},
+    {-4.05845151377397184e-01, 3.81830050505118923e-01},
+    { 0.00000000000000000e+00, 4.17959183673469403e-01},
+    { 4.05845151377397184e-01, 3.81830050505118923e-01},
+    { 7.41531185599394460e-01, 2.79705391489276645e-01},
+    { 9.49107912342758486e-01, 1.29484966168869703e-01},
+    // n = 8
+    {-9.60289856497536287e-01, 1.01228536290376259e-01},
+    {-7.96666477413626728e-01, 2.22381034453374482e-01},
+    {-5.25532409916328991e-01, 3.13706645877887269e-01},
+    {-1.83434642495649808e-01, 3.62683783378361990e-01},
+    { 1.83434642495649808e-01, 3.62683783378361990e-01},
+    { 5.25532409916328991e-01, 3.13706645877887269e-01},
+    { 7.96666477413626728e-01, 2.22381034453374482e-01},
+    { 9.60289856497536287e-01, 1.01228536290376259e-01},
+    // n = 9
+    {-9.68160239507626086e-01, 8.12743883615744123e-02},
+    {-8.36031107326635770e-01, 1.80648160694857396e-01},
+    {-6.13371432700590358e-01, 2.60610696402935438e-01},
+    {-3.24253423403808916e-01, 3.12347077040002863e-01},
+    { 0.00000000000000000e+00, 3.30239355001259782e-01},
+    { 3.24253423403808916e-01, 3.12347077040002863e-01},
+    { 6.13371432700590358e-01, 2.60610696402935438e-01},
+    { 8.36031107326635770e-01, 1.80648160694857396e-01},
+    { 9.68160239507626086e-01, 8.12743883615744123e-02},
+    // n = 10
+    {-9.73906528517171743e-01, 6.66713443086881380e-02},
+    {-8.65063366688984536e-01, 1.49451349150580587e-01},
+    {-6.79409568299024436e-01, 2.19086362515982042e-01},
+    {-4.33395394129247213e-01, 2.69266719309996350e-01},
+    {-1.48874338981631216e-01, 2.95524224714752870e-01},
+    { 1.48874338981631216e-01, 2.95524224714752870e-01},
+    { 4.33395394129247213e-01, 2.69266719309996350e-01},
+    { 6.79409568299024436e-01, 2.19086362515982042e-01},
+    { 8.65063366688984536e-01, 1.49451349150580587e-01},
+    { 9.73906528517171743e-01, 6.66713443086881380e-02},
+};
+
+/* Evaluate the Legendre polynomial P_n and its derivative at x in (-1, 1) by the three-term
+ * recurrence (k+1)P_{k+1} = (2k+1)x P_k - k P_{k-1}. */
+inline void legendre_poly(int n, double x, double &p, double &dp) {
+    double p_prev = 1.0;
+    p = x;
+    for (int k = 1; k < n; ++k) {
+        const double p_next = ((2*k + 1)*x*p - k*p_prev)/(k + 1);
+        p_prev = p;
+        p = p_next;
+    }
+    dp = n*(x*p - p_prev)/(x*x - 1.0);
+}
+
+} // end namespace detail
+
+/* Compute the Gauss-Legendre nodes and weights on [-1, 1] for meshsize points.
  *
- * A meshsize < 0 throws an std::domain_error, and meshsize == 0 is guaranteed to return 0.0.
- * If a GSL error occurs, prints to stderr and return 0.0.
+ * Small meshsizes are read off a table. Otherwise each root of P_meshsize is found by Newton's
+ * method starting from the asymptotic estimate cos(pi*(k+3/4)/(meshsize+1/2)), which converges in
+ * a handful of iterations, and the weight is 2/((1-x^2) P'(x)^2). Only the roots in (0, 1) are
+ * found; the rest follow by symmetry.
+ *
+ * A meshsize < 1 throws an std::domain_error.
  */
-double legendre(double begin, double end, int meshsize, integrand_fptr_t func) {
-    if (meshsize < 0)
+legendre_rule::legendre_rule(int meshsize) : nodes_(meshsize), weights_(meshsize) {
+    if (meshsize < 1)
         throw std::domain_error("meshsize must be positive");
-    else if (meshsize == 0)
-        return 0.0;
 
-    gsl_function gfunc;
-    // This is hacky... but it should work. Note that func actually only takes one argument...
-    gfunc.function = (double (*)(double, void *)) func;
-    gfunc.params = nullptr;
+    if (meshsize <= detail::legendre_table_max) {
+        const detail::node_weight *rule = detail::legendre_table + meshsize*(meshsize-1)/2;
+        for (int k = 0; k < meshsize; ++k) {
+            nodes_[k] = rule[k].node;
+            weights_[k] = rule[k].weight;
+        }
+        return;
+    }
 
-    auto workspace = gsl_integration_fixed_alloc(
-        gsl_integration_fixed_legendre, meshsize, begin, end, 0.0, 0.0
-    );
+    const double pi = 3.14159265358979323846;
+    for (int k = 0; k < (meshsize+1)/2; ++k) {
+        double x = std::cos(pi*(k + 0.75)/(meshsize + 0.5));
+        double p, dp;
+        for (int iter = 0; iter < 100; ++iter) {
+            detail::legendre_poly(meshsize, x, p, dp);
+            const double dx = p/dp;
+            x -= dx;
+            if (std::abs(dx) <= 1e-16)
+                break;
+        }
+        detail::legendre_poly(meshsize, x, p, dp);
 
-    double ret;
-    // This performs the integration, putting the result in ret.
-    int err = gsl_integration_fixed(&gfunc, &ret, workspace);
-    gsl_integration_fixed_free(workspace);
-    if (err) {
-        std::cerr << __FILE__ << ':' << __LINE__ << ": WARNING: GSL error code " << err
-                  << ". Returning 0.0." << std::endl;
+        // Roots come out in descending order
+        const double weight = 2.0/((1.0 - x*x)*dp*dp);
+        nodes_[meshsize-1-k] = x;
+        nodes_[k] = -x;
+        weights_[meshsize-1-k] = weights_[k] = weight;
     }
+    // The middle root of an odd order polynomial is exactly 0
+    if (meshsize % 2 != 0)
+        nodes_[meshsize/2] = 0.0;
+}
 
-    return ret;
+/* Look up the rule for meshsize in a process wide cache, computing it on first use. The lock is
+ * not held while computing, so threads asking for different meshsizes do not wait on each other;
+ * if two threads race on the same meshsize, the first one stored wins. */
+std::shared_ptr<const legendre_rule> legendre_rule::get(int meshsize) {
+    static std::mutex cache_mutex;
+    static std::map<int, std::shared_ptr<const legendre_rule>> cache;
+
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        auto it = cache.find(meshsize);
+        if (it != cache.end())
+            return it->second;
+    }
+
+    auto rule = std::make_shared<const legendre_rule>(meshsize);
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    return cache.emplace(meshsize, std::move(rule)).first->second;
+}
+
+/* Integrate func(x) between x=begin and x=end by mapping the nodes affinely from [-1, 1]:
+ *     x_k = (end+begin)/2 + (end-begin)/2*t_k,   w_k -> (end-begin)/2*w_k
+ */
+template<class F, class Acc>
+double legendre_rule::operator()(double begin, double end, F func) const {
+    const double mid = (end + begin)/2.0;
+    const double half = (end - begin)/2.0;
+
+    const double integral = detail::blocked_sum<Acc>(weights_.data(), meshsize(), [&](int k) {
+        return func(mid + half*nodes_[k]);
+    });
+
+    return half*integral;
+}
+
+/* Calculate integral of func(x) between x=begin and x=end with the Gauss-Legendre rule on
+ * meshsize points. The nodes and weights are computed once per meshsize and cached.
+ *
+ * A meshsize < 0 throws an std::domain_error, and meshsize == 0 is guaranteed to return 0.0.
+ */
+template<class F, class Acc> double legendre(double begin, double end, int meshsize, F func) {
+    if (meshsize < 0)
+        throw std::domain_error("meshsize must be positive");
+    else if (meshsize == 0)
+        return 0.0;
+
+    return legendre_rule::get(meshsize)->operator()<F, Acc>(begin, end, func);
 }
 
 // If we don't allow arbitrary template instantiation, then at least compile these.
 #ifndef HEADER_INLINE_TEMPLATES
-    template double simpson<integrand_t>(double, double, int, integrand_t);
-    template double simpson<integrand_fptr_t>(double, double, int, integrand_fptr_t);
-    template double milne<integrand_t>(double, double, int, integrand_t);
-    template double milne<integrand_fptr_t>(double, double, int, integrand_fptr_t);
+    #define INSTANTIATE_NEWTON_COTES(N, F, Acc) \
+        template double newton_cotes<N, F, Acc>(double, double, int, F);
+    #define INSTANTIATE_RULES(F, Acc) \
+        INSTANTIATE_NEWTON_COTES(1, F, Acc) \
+        INSTANTIATE_NEWTON_COTES(2, F, Acc) \
+        INSTANTIATE_NEWTON_COTES(3, F, Acc) \
+        INSTANTIATE_NEWTON_COTES(4, F, Acc) \
+        INSTANTIATE_NEWTON_COTES(5, F, Acc) \
+        INSTANTIATE_NEWTON_COTES(6, F, Acc) \
+        template double simpson<F, Acc>(double, double, int, F); \
+        template double milne<F, Acc>(double, double, int, F); \
+        template double legendre<F, Acc>(double, double, int, F); \
+        template double legendre_rule::operator()<F, Acc>(double, double, F) const; \
+        template class romberg<F, Acc>;
+    #define INSTANTIATE_BATCH_RULES(Acc) \
+        template double newton_cotes_batch<1, batch_integrand_t, Acc>(double, double, int, \
+                                                                      batch_integrand_t); \
+        template double newton_cotes_batch<2, batch_integrand_t, Acc>(double, double, int, \
+                                                                      batch_integrand_t); \
+        template double newton_cotes_batch<3, batch_integrand_t, Acc>(double, double, int, \
+                                                                      batch_integrand_t); \
+        template double newton_cotes_batch<4, batch_integrand_t, Acc>(double, double, int, \
+                                                                      batch_integrand_t); \
+        template double newton_cotes_batch<5, batch_integrand_t, Acc>(double, double, int, \
+                                                                      batch_integrand_t); \
+        template double newton_cotes_batch<6, batch_integrand_t, Acc>(double, double, int, \
+                                                                      batch_integrand_t); \
+        template double simpson_batch<batch_integrand_t, Acc>(double, double, int, \
+                                                              batch_integrand_t); \
+        template double milne_batch<batch_integrand_t, Acc>(double, double, int, \
+                                                            batch_integrand_t);
+
+    INSTANTIATE_RULES(integrand_t, naive_sum)
+    INSTANTIATE_RULES(integrand_t, kahan_sum)
+    INSTANTIATE_RULES(integrand_t, neumaier_sum)
+    INSTANTIATE_RULES(integrand_t, pairwise_sum)
+    INSTANTIATE_RULES(integrand_fptr_t, naive_sum)
+    INSTANTIATE_RULES(integrand_fptr_t, kahan_sum)
+    INSTANTIATE_RULES(integrand_fptr_t, neumaier_sum)
+    INSTANTIATE_RULES(integrand_fptr_t, pairwise_sum)
+    INSTANTIATE_BATCH_RULES(naive_sum)
+    INSTANTIATE_BATCH_RULES(kahan_sum)
+    INSTANTIATE_BATCH_RULES(neumaier_sum)
+    INSTANTIATE_BATCH_RULES(pairwise_sum)
+    #undef INSTANTIATE_NEWTON_COTES
+    #undef INSTANTIATE_RULES
+    #undef INSTANTIATE_BATCH_RULES
+
+    template node_set newton_cotes_nodes<1>(double, double, int);
+    template node_set newton_cotes_nodes<2>(double, double, int);
+    template node_set newton_cotes_nodes<3>(double, double, int);
+    template node_set newton_cotes_nodes<4>(double, double, int);
+    template node_set newton_cotes_nodes<5>(double, double, int);
+    template node_set newton_cotes_nodes<6>(double, double, int);
+    template adaptive_result adaptive_simpson<integrand_t>(double, double, double, double, int,
+                                                           integrand_t);
+    template adaptive_result adaptive_simpson<integrand_fptr_t>(double, double, double, double,
+                                                                int, integrand_fptr_t);
+    template void batch<batch_row_t>(const node_set &, int, batch_row_t, double *);
 #endif
 
 } // end namespace integrate
@@ -1,12 +1,106 @@
 #ifndef _INTEGRATE_H
 #define _INTEGRATE_H
 
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <vector>
+
 namespace integrate {
 
 // Sane C++ solution for arbitrary functions
 using integrand_t = std::function<double(double)>;
-// ...but e.g. GSL doesn't care, so we unfortunately need this.
+// ...and plain function pointers, which avoid the std::function overhead.
 using integrand_fptr_t = double (*)(double);
+// Batch integrand: fills ys[0...n) with the integrand evaluated at xs[0...n). Being handed a
+// whole block of abscissae at once lets the integrand vectorize, e.g. over std::exp.
+using batch_integrand_t = std::function<void(const double *xs, double *ys, int n)>;
+// Many integrands at one point: fills values[0...nfuncs) with every integrand evaluated at x.
+using batch_row_t = std::function<void(double x, double *values)>;
+
+/* Set the number of threads simpson and milne use when compiled with OMP defined; 0 (the
+ * default) uses OpenMP's default, e.g. from OMP_NUM_THREADS. Results do not depend on the number
+ * of threads. threads() gives the number that will actually be used, which is always 1 without
+ * OMP. */
+void set_threads(int nthreads);
+int threads();
+
+// Maximum number of abscissae passed to a batch integrand in one call.
+constexpr int batch_size = 256;
+
+/* Accumulator policies for the sums in the rules below, given as the Acc template parameter.
+ *
+ * Terms are summed in blocks of batch_size points, each block with four independent
+ * accumulators (so they fit in one vector register), and the block sums are then combined.
+ * naive_sum adds everything left to right; kahan_sum and neumaier_sum carry a compensation term
+ * for the rounding error of each addition; pairwise_sum (the default) is naive within a block
+ * but combines the block sums by recursive halving, so the error grows like log(n) at the cost
+ * of one stored double per block.
+ */
+struct naive_sum {
+    double sum = 0.0;
+
+    void add(double x) { sum += x; }
+    double result() const { return sum; }
+};
+
+struct kahan_sum {
+    double sum = 0.0;
+    double c = 0.0;
+
+    void add(double x) {
+        const double y = x - c;
+        const double t = sum + y;
+        c = (t - sum) - y;
+        sum = t;
+    }
+    double result() const { return sum; }
+};
+
+// Like kahan_sum, but also correct when a term is larger than the running sum
+struct neumaier_sum {
+    double sum = 0.0;
+    double c = 0.0;
+
+    void add(double x) {
+        const double t = sum + x;
+        c += std::abs(sum) >= std::abs(x) ? (sum - t) + x : (x - t) + sum;
+        sum = t;
+    }
+    double result() const { return sum + c; }
+};
+
+struct pairwise_sum : naive_sum {};
+
+/* Closed Newton-Cotes rule over one panel of Intervals intervals of width step:
+ *     integral ~ step*scale*sum(weights[k]*f(x_k)),  k = 0...Intervals
+ * Defined for Intervals = 1 (trapezoidal), 2 (Simpson), 3 (Simpson's 3/8), 4 (Milne/Boole),
+ * 5 and 6. */
+template<int Intervals> struct newton_cotes_rule;
+template<> struct newton_cotes_rule<1> {
+    static constexpr double scale = 1.0/2.0;
+    static constexpr double weights[2] = {1.0, 1.0};
+};
+template<> struct newton_cotes_rule<2> {
+    static constexpr double scale = 1.0/3.0;
+    static constexpr double weights[3] = {1.0, 4.0, 1.0};
+};
+template<> struct newton_cotes_rule<3> {
+    static constexpr double scale = 3.0/8.0;
+    static constexpr double weights[4] = {1.0, 3.0, 3.0, 1.0};
+};
+template<> struct newton_cotes_rule<4> {
+    static constexpr double scale = 1.0/45.0;
+    static constexpr double weights[5] = {14.0, 64.0, 24.0, 64.0, 14.0};
+};
+template<> struct newton_cotes_rule<5> {
+    static constexpr double scale = 5.0/288.0;
+    static constexpr double weights[6] = {19.0, 75.0, 50.0, 50.0, 75.0, 19.0};
+};
+template<> struct newton_cotes_rule<6> {
+    static constexpr double scale = 1.0/140.0;
+    static constexpr double weights[7] = {41.0, 216.0, 27.0, 272.0, 27.0, 216.0, 41.0};
+};
 
 /* Integrate func using the respective method over the inclusive range [begin,
  * end] on meshsize number of points.
@@ -16,9 +110,136 @@ using integrand_fptr_t = double (*)(double);
  *
  * func is expected to take a single argument that is a double and return a
  * double */
-template<class F> double simpson(double begin, double end, int meshsize, F func);
-template<class F> double   milne(double begin, double end, int meshsize, F func);
-double legendre(double begin, double end, int meshsize, integrand_fptr_t func);
+template<class F, class Acc = pairwise_sum>
+double simpson(double begin, double end, int meshsize, F func);
+template<class F, class Acc = pairwise_sum>
+double milne(double begin, double end, int meshsize, F func);
+template<class F, class Acc = pairwise_sum>
+double legendre(double begin, double end, int meshsize, F func);
+
+/* Composite newton_cotes_rule<Intervals>, of which simpson and milne are the cases 2 and 4.
+ * meshsize-1 is rounded up to a multiple of Intervals. */
+template<int Intervals, class F, class Acc = pairwise_sum>
+double newton_cotes(double begin, double end, int meshsize, F func);
+
+/* Same as above, but func is a batch integrand: it is called as func(xs, ys, n) with
+ * n <= batch_size and must set ys[k] to the integrand at xs[k] for k = 0...n-1. */
+template<class B, class Acc = pairwise_sum>
+double simpson_batch(double begin, double end, int meshsize, B func);
+template<class B, class Acc = pairwise_sum>
+double milne_batch(double begin, double end, int meshsize, B func);
+template<int Intervals, class B, class Acc = pairwise_sum>
+double newton_cotes_batch(double begin, double end, int meshsize, B func);
+
+
+// Nodes and weights of a quadrature rule on a fixed interval; the integral is sum(w[k]*f(x[k])).
+struct node_set {
+    std::vector<double> nodes;
+    std::vector<double> weights;
+};
+
+node_set simpson_nodes(double begin, double end, int meshsize);
+node_set   milne_nodes(double begin, double end, int meshsize);
+node_set legendre_nodes(double begin, double end, int meshsize);
+template<int Intervals> node_set newton_cotes_nodes(double begin, double end, int meshsize);
+
+/* Integrate nfuncs integrands on the shared nodes of rule, writing the integrals to
+ * out[0...nfuncs).
+ *
+ * func is called once per node as func(x, values) and must fill values[0...nfuncs) with every
+ * integrand at x, so any work the integrands share at x (e.g. evaluating a basis function) is
+ * done once per node rather than once per integrand. The second overload takes the integrands
+ * separately. nfuncs < 0 throws an std::domain_error.
+ */
+template<class F> void batch(const node_set &rule, int nfuncs, F func, double *out);
+void batch(const node_set &rule, const std::vector<integrand_t> &funcs, double *out);
+
+// Result of an adaptive integration
+struct adaptive_result {
+    double value;       // estimate of the integral
+    double error;       // estimate of the absolute error in value
+    int evaluations;    // number of calls to the integrand
+};
+
+/* Integrate func over [begin, end] with adaptive Simpson's rule, refining the subinterval with
+ * the largest error estimate until the total estimated error is at most
+ * max(abs_tol, rel_tol*|value|), or until another refinement would take more than max_evals
+ * evaluations.
+ *
+ * Every evaluation is reused: splitting a subinterval costs 4 new evaluations. A max_evals < 5
+ * throws an std::domain_error.
+ */
+template<class F> adaptive_result adaptive_simpson(double begin, double end, double abs_tol,
+                                                   double rel_tol, int max_evals, F func);
+
+/* Nested sequence of composite rules on [begin, end] with Romberg extrapolation.
+ *
+ * Starts from the trapezoidal rule on the given number of intervals. Each refine() halves the
+ * step and only evaluates func at the new midpoints, so no evaluation is ever repeated. Row k of
+ * the Romberg table extrapolates the trapezoidal rules of rows 0...k by Richardson's method; its
+ * second and third columns are exactly the composite Simpson and Milne rules on the current
+ * mesh, so refining a Simpson or Milne result costs only the new points.
+ *
+ * intervals < 1 throws an std::domain_error, and asking for a column that does not exist yet
+ * (simpson() before the first refine(), milne() before the second) throws an std::logic_error.
+ */
+template<class F, class Acc = pairwise_sum> class romberg {
+public:
+    romberg(double begin, double end, int intervals, F func);
+
+    // Halve the step, evaluating func only at the new points.
+    void refine();
+
+    int meshsize() const { return intervals_ + 1; }
+    int levels() const { return int(table_.size()); }
+    long evaluations() const { return evaluations_; }
+
+    // Rules on the current mesh
+    double trapezoid() const { return column(0); }
+    double simpson() const { return column(1); }
+    double milne() const { return column(2); }
+
+    // Most extrapolated value, and an estimate of its error from the previous column.
+    double extrapolated() const { return table_.back().back(); }
+    double error() const;
+
+private:
+    double column(int j) const;
+
+    double begin_, end_;
+    int intervals_;
+    F func_;
+    long evaluations_;
+    // Sum of func over the mesh with trapezoidal weights (1/2, 1, ..., 1, 1/2)
+    Acc sum_;
+    std::vector<std::vector<double>> table_;
+};
+
+/* Gauss-Legendre nodes and weights for meshsize points on [-1, 1].
+ *
+ * Computing the nodes is by far the most expensive part of legendre(), so callers integrating
+ * many times on the same meshsize should hold on to a rule, either one of their own or the
+ * cached one from legendre_rule::get, and call it for each interval.
+ */
+class legendre_rule {
+public:
+    explicit legendre_rule(int meshsize);
+
+    // Shared rule for meshsize out of a cache; safe to call from multiple threads.
+    static std::shared_ptr<const legendre_rule> get(int meshsize);
+
+    int meshsize() const { return int(nodes_.size()); }
+    const std::vector<double> &nodes() const { return nodes_; }
+    const std::vector<double> &weights() const { return weights_; }
+
+    // Integrate func over [begin, end], rescaling the nodes and weights from [-1, 1].
+    template<class F, class Acc = pairwise_sum>
+    double operator()(double begin, double end, F func) const;
+
+private:
+    std::vector<double> nodes_;
+    std::vector<double> weights_;
+};
 
 } // end namespace integrate
 
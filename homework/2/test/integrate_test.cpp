@@ -1,33 +1,60 @@
 #include <array>
+#include <algorithm>
 #include <cmath>
 #include <cassert>
 #include <iostream>
 #include <iomanip>
 #include <functional>
 #include <string>
-#ifdef OMP
-    #include <omp.h>
-#endif
 #include "../integrate.h"
 
-// We're using integrate::integrand_fptr_t because integrate::legendre uses gsl.
-using method_t = std::function<double(double, double, int, integrate::integrand_fptr_t)>;
-
 constexpr size_t nmethods = 3;
-const std::array<method_t, nmethods> methods = {
-    &integrate::simpson<integrate::integrand_fptr_t>,
-    &integrate::milne<integrate::integrand_fptr_t>,
-    &integrate::legendre
-};
-const std::array<const char *, nmethods> method_names = {"simpson", "milne", "gsl_legendre"};
+const std::array<const char *, nmethods> method_names = {"simpson", "milne", "legendre"};
+
+/* Number of intervals simpson/milne use for meshsize points: meshsize-1 rounded up to a nonzero
+ * multiple of the panel width. */
+int panel_intervals(int meshsize, int panel) {
+    const int intervals = std::max(meshsize - 1, 1);
+    return (intervals + panel - 1)/panel*panel;
+}
+
+/* Simpson's and Milne's rules on meshsize points and on twice as many intervals, out of one
+ * romberg sequence each, so the first mesh's evaluations are reused for the doubled one. */
+template<class F>
+std::array<double, 4> romberg_rules(double begin, double end, int meshsize, F test_func) {
+    using integrate::integrand_t;
+    std::array<double, 4> vals;
+
+    // Simpson's rule needs the trapezoidal rules on N/2 and N intervals
+    integrate::romberg<integrand_t> simpson(begin, end, panel_intervals(meshsize, 2)/2,
+                                            test_func);
+    simpson.refine();
+    vals[0] = simpson.simpson();
+    simpson.refine();
+    vals[2] = simpson.simpson();
+
+    // Milne's rule on N/4, N/2 and N intervals
+    integrate::romberg<integrand_t> milne(begin, end, panel_intervals(meshsize, 4)/4,
+                                          test_func);
+    milne.refine();
+    milne.refine();
+    vals[1] = milne.milne();
+    milne.refine();
+    vals[3] = milne.milne();
+
+    return vals;
+}
 
 /* Output to stream the result of integrating test_func(x) between x=begin and x=end on
- * meshsize=meshmap(n) points for n=1...n_meshsizes.
+ * meshsize=meshmap(n) points for n=1...n_meshsizes, and on twice as many intervals.
+ * Simpson's and Milne's rules come from romberg_rules.
  */
 template<class F1, class F2>
 void make_integrate_data(std::ostream &stream, double begin, double end, int n_meshsizes,
                          F1 test_func, F2 meshmap)
 {
+    using integrate::integrand_t;
+
     stream << std::left << "meshsize";
     for (auto &&name: method_names) stream << ' ' << name;
     for (auto &&name: method_names) stream << ' ' << name << "_double";
@@ -36,22 +63,66 @@ void make_integrate_data(std::ostream &stream, double begin, double end, int n_m
     stream << std::right << std::setprecision(16) << std::scientific;
     for (int n = 1; n <= n_meshsizes; ++n) {
         auto meshsize = meshmap(n);
+        std::array<double, nmethods> vals, vals_double;
+
+        const auto rules = romberg_rules(begin, end, meshsize, test_func);
+        vals[0] = rules[0];
+        vals[1] = rules[1];
+        vals_double[0] = rules[2];
+        vals_double[1] = rules[3];
+
+        vals[2] = integrate::legendre<integrand_t>(begin, end, meshsize, test_func);
+        vals_double[2] = integrate::legendre<integrand_t>(begin, end, 2*meshsize, test_func);
 
         stream << meshsize;
-        // Integrations
-        for (size_t i = 0; i < methods.size(); ++i) {
-            auto val = methods[i](begin, end, meshsize, test_func);
-            stream << ' ' << val;
-        }
-        // Doubled meshsize
-        for (size_t i = 0; i < methods.size(); ++i) {
-            auto val = methods[i](begin, end, 2*meshsize, test_func);
-            stream << ' ' << val;
-        }
+        for (auto &&val: vals) stream << ' ' << val;
+        for (auto &&val: vals_double) stream << ' ' << val;
         stream << '\n';
     }
 }
 
+/* Largest relative difference allowed between romberg_rules and the composite rules on the
+ * same mesh; they differ only in the order of summation. */
+constexpr double composite_tolerance = 1e-12;
+
+/* Check romberg_rules against integrate::simpson and integrate::milne (the threaded composite
+ * sums) on the same meshes as make_integrate_data. Returns false, after reporting each
+ * disagreement on std::cerr, if any of them differ by more than composite_tolerance.
+ */
+template<class F1, class F2>
+bool check_composite(double begin, double end, int n_meshsizes, F1 test_func, F2 meshmap) {
+    using integrate::integrand_t;
+    const std::array<const char *, 4> names = {"simpson", "milne", "simpson_double",
+                                               "milne_double"};
+
+    bool agree = true;
+    for (int n = 1; n <= n_meshsizes; ++n) {
+        auto meshsize = meshmap(n);
+        const auto rules = romberg_rules(begin, end, meshsize, test_func);
+
+        // The same numbers of intervals, with one more point than intervals
+        const int simpson_intervals = panel_intervals(meshsize, 2);
+        const int milne_intervals = panel_intervals(meshsize, 4);
+        const std::array<double, 4> composite = {
+            integrate::simpson<integrand_t>(begin, end, simpson_intervals + 1, test_func),
+            integrate::milne<integrand_t>(begin, end, milne_intervals + 1, test_func),
+            integrate::simpson<integrand_t>(begin, end, 2*simpson_intervals + 1, test_func),
+            integrate::milne<integrand_t>(begin, end, 2*milne_intervals + 1, test_func)
+        };
+
+        for (size_t i = 0; i < names.size(); ++i) {
+            if (std::abs(rules[i] - composite[i]) > composite_tolerance*std::abs(composite[i])) {
+                std::cerr << std::setprecision(16) << "romberg " << names[i]
+                          << " disagrees with the composite rule at meshsize " << meshsize
+                          << ": " << rules[i] << " vs. " << composite[i] << std::endl;
+                agree = false;
+            }
+        }
+    }
+
+    return agree;
+}
+
 /* For logarithmic plotting, we want an increasing one-to-one function of integers n that is
  * like 10^n but more closely spaced. So 10^(n/a) is almost there, but its only one-to-one for
  * large enough n. We instead give n for small n < N and 10^(n/a) for n >= N; we find the
@@ -71,24 +142,39 @@ int sorta_exp10(int n, double a) {
 }
 
 int main(int argc, char **argv) {
-    if (argc != 5) {
-        std::cerr << "Invalid number of arguments: expected 2, got " << argc-1 << '\n'
-                  << "Usage: " << argv[0] << " <begin> <end> <n_meshsizes> <a>" << std::endl;
+    // With --check, compare the romberg rules with the composite ones instead of writing data
+    const char *program = argv[0];
+    const bool check = argc > 1 && std::string(argv[1]) == "--check";
+    if (check) {
+        --argc;
+        ++argv;
+    }
+
+    if (argc != 5 && argc != 6) {
+        std::cerr << "Invalid number of arguments: expected 4 or 5, got " << argc-1 << '\n'
+                  << "Usage: " << program << " [--check] <begin> <end> <n_meshsizes> <a>"
+                  << " [<threads>]" << std::endl;
         return 1;
     }
 
+    if (argc == 6)
+        integrate::set_threads(std::stoi(argv[5]));
     #ifdef OMP
-    std::cerr << "Number of available threads: " << omp_get_max_threads() << std::endl;
+    std::cerr << "Number of threads: " << integrate::threads() << std::endl;
     #endif
 
     double begin = std::stod(argv[1]);
     double end = std::stod(argv[2]);
     double n_meshsizes = std::stoi(argv[3]);
     double a = std::stod(argv[4]);
-    double (*func)(double) = &std::exp;
+    auto func = [](double x) { return std::exp(x); };
+
+    auto meshmap = [a](int n) { return sorta_exp10(n, a); };
+
+    if (check)
+        return check_composite(begin, end, n_meshsizes, func, meshmap) ? 0 : 1;
 
-    make_integrate_data(std::cout, begin, end, n_meshsizes, func,
-                        [a](int n) { return sorta_exp10(n, a); });
+    make_integrate_data(std::cout, begin, end, n_meshsizes, func, meshmap);
 
     return 0;
 }
@@ -9,12 +9,27 @@
 //      01/14/04  original version, translated from derivative_test.c
 //      01/20/05  modified extrap_diff to use central_diff
 //      03/28/19  Add extrap_diff2 based off extrap_diff
+//      10/18/26  diff_batch: all four rules at many (x, h) from one
+//                batched evaluation of f at the distinct points
+//      10/18/26  richardson_diff: Richardson tableau to any order,
+//                stopping when converged, on cached values of f
+//      10/18/26  Sweeps over (function, x, h) from the command line,
+//                in parallel, through a buffered text/binary writer
 //
 //  Notes:
 //   * Based on the discussion of differentiation in Chap. 8
 //      of "Computational Physics" by Landau and Paez.
 //   * As a convention (advocated in "Practical C"), we'll append
 //      "_ptr" to all pointers.
+//   * diff_batch evaluates the same rules with each f(x) computed
+//      once, through a function that takes a whole array of x.
+//   * richardson_diff continues extrap_diff and extrap_diff2 to as
+//      many levels as it takes to converge, with 2 new values of f
+//      per level.
+//   * With arguments, the program instead sweeps every combination of
+//      the functions in function_table, x and h given on the command
+//      line (see run_sweep), in parallel when compiled with
+//      -fopenmp -DOMP (make binaries_omp).
 //   * Use the adaptive gsl_diff_central function as well.
 //      Output from this with e^(-x) at x=1 is:
 //  gsl_diff_central(1) = -3.6787944117560983e-01 +/- 6.208817e-04
@@ -25,13 +40,65 @@
 #include <iostream>		// note that .h is omitted
 #include <iomanip>		// note that .h is omitted
 #include <fstream>		// note that .h is omitted
+#include <vector>
+#include <map>
+#include <string>
+#include <sstream>
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+#include <cstdint>
 using namespace std;		// we need this when .h is omitted
 #include <gsl/gsl_math.h>
 #include <gsl/gsl_diff.h>
 
-// function prototypes 
+// structures and function prototypes
+typedef struct			// derivative estimates by each rule
+{
+  double forward;		// forward_diff
+  double central;		// central_diff
+  double extrap;		// extrap_diff
+  double extrap2;		// extrap_diff2
+}
+diff_estimates;
+
+typedef struct			// f, remembering its value at every point
+{
+  double (*f) (double x, void *params_ptr);
+  void *params_ptr;
+  map<double, double> values;	// f(x) by x
+  int evaluations;		// calls of f so far
+}
+cached_function;
+
+typedef struct			// output gathered in memory, written in large pieces
+{
+  FILE *file_ptr;
+  vector<char> buffer;
+  size_t used;
+}
+buffered_writer;
+
 double funct (double x, void *params_ptr);
+void funct_batch (int n, const double *x, double *fx, void *params_ptr);
 double funct_deriv (double x, void *params_ptr);
+double sine (double x, void *params_ptr);
+void sine_batch (int n, const double *x, double *fx, void *params_ptr);
+double sine_deriv (double x, void *params_ptr);
+
+typedef struct			// a function to sweep, with its derivative
+{
+  const char *name;
+  void (*f_batch) (int n, const double *x, double *fx, void *params_ptr);
+  double (*deriv) (double x, void *params_ptr);
+}
+function_entry;
+
+const function_entry function_table[] = {
+  {"exp", funct_batch, funct_deriv},		// e^(-alpha x)
+  {"sin", sine_batch, sine_deriv},		// sin(alpha x)
+};
+const int nfunctions = sizeof(function_table) / sizeof(function_table[0]);
 
 double forward_diff(double x, double h, double (*f) (double x, void *params_ptr),
 		            void *params_ptr);
@@ -41,16 +108,31 @@ double extrap_diff(double x, double h, double (*f) (double x, void *params_ptr),
                    void *params_ptr);
 double extrap_diff2(double x, double h, double (*f)(double x, void *params_ptr),
                     void *params_ptr);
+void diff_batch(int n, const double *x, const double *h,
+                void (*f_batch) (int n, const double *x, double *fx, void *params_ptr),
+                void *params_ptr, diff_estimates *diffs);
+double cached_eval(cached_function *F_ptr, double x);
+double richardson_diff(double x, double h, cached_function *F_ptr, double tolerance,
+                       double *abserr_ptr);
+
+// sweeps over (function, x, h)
+int run_sweep(int argc, char **argv);
+bool parse_values(const string &list, bool halving, vector<double> &values);
+void print_usage(const char *program);
+void writer_open(buffered_writer *writer_ptr, FILE *file_ptr);
+void writer_put(buffered_writer *writer_ptr, const void *data, size_t size);
+void writer_close(buffered_writer *writer_ptr);
 
 //************************** main program ***************************
-int main (void) {
+int main (int argc, char **argv) {
+  if (argc > 1)
+    return run_sweep(argc, argv);
+
   void *params_ptr;		// void pointer passed to functions 
 
   const double hmin = 1.0/double(1 << 7);	// minimum mesh size 
   double x = 1.;		// find the derivative at x 
   double alpha = 1.;		// a parameter for the function 
-  double diff_cd, diff_fd;	// central, forward difference 
-  double diff_extrap, diff_extrap2;		// extrapolated derivative 
   double diff_gsl_cd;		// gsl adaptive central derivative 
   gsl_function My_F;		// gsl_function type 
   double abserr;                // absolute error
@@ -71,6 +153,15 @@ int main (void) {
   cout << " actual relative error: " << setprecision (8)
     << fabs((diff_gsl_cd - answer) / answer) << endl;
 
+  cached_function F_cached = {&funct, params_ptr, {}, 0};
+  double diff_richardson = richardson_diff(x, 1., &F_cached, 1.e-13, &abserr);
+  cout << "richardson_diff(" << defaultfloat << x << ") = " << scientific
+    << setprecision(16) << diff_richardson << " +/- "
+    << setprecision(6) << abserr << " (" << F_cached.evaluations
+    << " evaluations)" << endl;
+  cout << " actual relative error: " << setprecision (8)
+    << fabs((diff_richardson - answer) / answer) << endl;
+
   const int prec = 8; const int width = prec+7;
   const char *const pad = "   ";
   out << left << "# log10(h) vs. log10(rel errs)\n"
@@ -81,21 +172,22 @@ int main (void) {
       << setw(width) << "extrap_diff2" << '\n'
       << right << scientific << setprecision(prec);
 
-  double h = double(1 << 7);		// initialize mesh spacing 
-  while (h >= hmin) {
-      diff_fd = forward_diff(x, h, &funct, params_ptr);
-      diff_cd = central_diff(x, h, &funct, params_ptr);
-      diff_extrap = extrap_diff(x, h, &funct, params_ptr);
-      diff_extrap2 = extrap_diff2(x, h, &funct, params_ptr);
+  // every mesh spacing, differentiated in one batch
+  vector<double> hs, xs;
+  for (double h = double(1 << 7); h >= hmin; h /= 2.) {	// reduce mesh by 2
+      hs.push_back(h);
+      xs.push_back(x);
+  }
+  vector<diff_estimates> diffs(hs.size());
+  diff_batch(hs.size(), xs.data(), hs.data(), &funct_batch, params_ptr, diffs.data());
 
+  for (size_t k = 0; k < hs.size(); ++k) {
       // print relative errors to output file 
-      out << setw(width) << log10(h) << pad
-	      << setw(width) << log10(fabs((diff_fd - answer) / answer)) << pad
-	      << setw(width) << log10(fabs((diff_cd - answer) / answer)) << pad
-	      << setw(width) << log10(fabs((diff_extrap - answer) / answer)) << pad
-          << setw(width) << log10(fabs((diff_extrap2 - answer) / answer)) << '\n';
-
-      h /= 2.;		// reduce mesh by 2 
+      out << setw(width) << log10(hs[k]) << pad
+	      << setw(width) << log10(fabs((diffs[k].forward - answer) / answer)) << pad
+	      << setw(width) << log10(fabs((diffs[k].central - answer) / answer)) << pad
+	      << setw(width) << log10(fabs((diffs[k].extrap - answer) / answer)) << pad
+          << setw(width) << log10(fabs((diffs[k].extrap2 - answer) / answer)) << '\n';
   }
 
   out.close();      // close the output stream
@@ -112,6 +204,17 @@ funct (double x, void *params_ptr)
   return (exp (-alpha * x));
 }
 
+//************************** funct_batch ***************************
+// funct at the n points x, into fx
+void
+funct_batch (int n, const double *x, double *fx, void *params_ptr)
+{
+  const double alpha = *(double *) params_ptr;
+
+  for (int k = 0; k < n; k++)
+    fx[k] = exp (-alpha * x[k]);
+}
+
 //************************** funct_deriv *********************
 double
 funct_deriv (double x, void *params_ptr)
@@ -121,6 +224,33 @@ funct_deriv (double x, void *params_ptr)
   return (-alpha * exp (-alpha * x));
 }
 
+//************************** sine ***************************
+double
+sine (double x, void *params_ptr)
+{
+  double alpha = *(double *) params_ptr;
+
+  return (sin (alpha * x));
+}
+
+// sine at the n points x, into fx
+void
+sine_batch (int n, const double *x, double *fx, void *params_ptr)
+{
+  const double alpha = *(double *) params_ptr;
+
+  for (int k = 0; k < n; k++)
+    fx[k] = sin (alpha * x[k]);
+}
+
+double
+sine_deriv (double x, void *params_ptr)
+{
+  double alpha = *(double *) params_ptr;
+
+  return (alpha * cos (alpha * x));
+}
+
 //************************** forward_diff *********************
 double
 forward_diff (double x, double h,
@@ -151,3 +281,350 @@ double extrap_diff2(double x, double h, double (*f)(double x, void *params_ptr),
 {
     return (16.0*extrap_diff(x, h/2.0, f, params_ptr) - extrap_diff(x, h, f, params_ptr))/15.0;
 }
+
+//************************** diff_batch *********************
+//
+// The four rules above for the derivative at x[k] with mesh size
+//  h[k], k = 0..n-1, into diffs[k], with a single call of f_batch.
+//   * Together the rules need f only at x + s h for the 8 distinct
+//      offsets s in stencil_offsets, where called one by one they
+//      evaluate f 16 times (extrap_diff2 alone 8, repeating the
+//      points of the lower levels).  All the points of all the (x, h)
+//      are gathered into one array for f_batch.
+//   * The values are then combined exactly as in the single-point
+//      rules, so the results are the same to the last bit.
+//
+//*************************************************************
+void diff_batch(int n, const double *x, const double *h,
+                void (*f_batch) (int n, const double *x, double *fx, void *params_ptr),
+                void *params_ptr, diff_estimates *diffs)
+{
+  // f(x + s h) for s = 0, 1, then +-1/2, +-1/4, +-1/8 (central
+  //  differences with h, h/2, h/4)
+  const int nstencil = 8;
+  const double stencil_offsets[nstencil] = {0., 1., 1./2., -1./2., 1./4., -1./4.,
+                                            1./8., -1./8.};
+
+  vector<double> points(n * nstencil), values(n * nstencil);
+  for (int k = 0; k < n; ++k) {
+      for (int s = 0; s < nstencil; ++s)
+          points[k*nstencil + s] = x[k] + stencil_offsets[s] * h[k];
+  }
+  f_batch(n * nstencil, points.data(), values.data(), params_ptr);
+
+  for (int k = 0; k < n; ++k) {
+      const double *const f = &values[k*nstencil];
+      // central differences with h, h/2 and h/4
+      const double cd_1 = (f[2] - f[3]) / h[k];
+      const double cd_2 = (f[4] - f[5]) / (h[k]/2.);
+      const double cd_4 = (f[6] - f[7]) / (h[k]/4.);
+      const double extrap_1 = (4.*cd_2 - cd_1) / 3.;
+      const double extrap_2 = (4.*cd_4 - cd_2) / 3.;
+
+      diffs[k].forward = (f[1] - f[0]) / h[k];
+      diffs[k].central = cd_1;
+      diffs[k].extrap = extrap_1;
+      diffs[k].extrap2 = (16.0*extrap_2 - extrap_1)/15.0;
+  }
+}
+
+//************************** cached_eval *********************
+// f(x), calling f only the first time x is asked for
+double cached_eval(cached_function *F_ptr, double x) {
+  map<double, double>::iterator found = F_ptr->values.find(x);
+  if (found != F_ptr->values.end())
+      return found->second;
+
+  F_ptr->evaluations++;
+  return F_ptr->values[x] = F_ptr->f(x, F_ptr->params_ptr);
+}
+
+//************************** richardson_diff *********************
+//
+// Derivative of f at x by Richardson extrapolation of central
+//  differences with mesh sizes h_k = h/2^k:
+//     D(k,0) = central_diff(x, h_k)
+//     D(k,m) = (4^m D(k,m-1) - D(k-1,m-1)) / (4^m - 1),
+//  so that D(1,1) is extrap_diff(x, h) and D(2,2) extrap_diff2(x, h).
+//   * Each level k needs just the 2 new values f(x +- h_k/2); the
+//      rest of the row comes from the previous one.  The values go
+//      through F_ptr's cache, so further calls at the same x (e.g.
+//      with the next h) reuse the points they share.
+//   * Stops when successive diagonal entries agree to tolerance
+//      (relative), or when they start to disagree more (round-off
+//      has taken over), or after max_levels.  *abserr_ptr is the
+//      last difference of the diagonal entries, as an error estimate.
+//
+//*************************************************************
+double richardson_diff(double x, double h, cached_function *F_ptr, double tolerance,
+                       double *abserr_ptr)
+{
+  const int max_levels = 16;
+  vector<double> row, previous;		// D(k,.) and D(k-1,.)
+  double best = 0., best_error = HUGE_VAL;
+
+  for (int k = 0; k < max_levels; ++k) {
+      const double h_k = h / double(1 << k);
+      previous.swap(row);
+      row.resize(k+1);
+      row[0] = (cached_eval(F_ptr, x + h_k/2.) - cached_eval(F_ptr, x - h_k/2.)) / h_k;
+      double factor = 1.;
+      for (int m = 1; m <= k; ++m) {
+          factor *= 4.;
+          row[m] = (factor*row[m-1] - previous[m-1]) / (factor - 1.);
+      }
+      if (k == 0) {
+          best = row[0];
+          continue;
+      }
+
+      const double error = fabs(row[k] - previous[k-1]);
+      if (error >= best_error)
+          break;			// round-off from here on
+      best = row[k];
+      best_error = error;
+      if (error <= tolerance * fabs(best))
+          break;
+  }
+
+  *abserr_ptr = best_error;
+  return best;
+}
+
+//************************** run_sweep *********************
+//
+// derivative_test.x [-o file] [-b] <functions> <x> <h>
+//  Relative errors of the four rules for every combination of the
+//  functions (names from function_table), x and h, one row each,
+//  ordered by function, then x, then h:
+//     function  x  log10(h)  and log10(rel. err.) of forward_diff,
+//     central_diff, extrap_diff and extrap_diff2
+//   * Each argument is a comma-separated list; x may also be
+//      first:last:n (n evenly spaced values) and h hmax:hmin (halving
+//      from hmax down to hmin).
+//   * The x are done in blocks: the rows of a block are computed in
+//      parallel (with OMP), one diff_batch call per x, and then
+//      written out before the next block, so the memory used does not
+//      grow with the number of x.
+//   * Rows are formatted with snprintf into a buffered_writer, which
+//      writes in large pieces, to stdout or the file given with -o.
+//   * With -b the output is binary instead, in the native byte order:
+//        char     magic[8]        "DERIVSWP"
+//        uint32   version         1
+//        uint32   nfunctions
+//        char     names[nfunctions][16]   NUL padded
+//      then one record of 7 doubles per row, as in the text (the
+//      function as its index in names).
+//
+//*************************************************************
+int run_sweep(int argc, char **argv) {
+  string out_file;		// stdout if empty
+  bool binary = false;
+  int arg = 1;
+  for (; arg < argc && argv[arg][0] == '-' && argv[arg][1] != '\0'
+         && !isdigit(argv[arg][1]) && argv[arg][1] != '.'; ++arg) {
+      if (strcmp(argv[arg], "-o") == 0 && arg+1 < argc)
+          out_file = argv[++arg];
+      else if (strcmp(argv[arg], "-b") == 0)
+          binary = true;
+      else
+          break;
+  }
+  if (argc - arg != 3) {
+      print_usage(argv[0]);
+      return 1;
+  }
+
+  vector<const function_entry *> functions;
+  {
+      istringstream names(argv[arg]);
+      string name;
+      while (getline(names, name, ',')) {
+          int f = 0;
+          while (f < nfunctions && name != function_table[f].name)
+              ++f;
+          if (f == nfunctions) {
+              cerr << "ERROR: Unknown function: " << name << endl;
+              print_usage(argv[0]);
+              return 1;
+          }
+          functions.push_back(&function_table[f]);
+      }
+  }
+  vector<double> xs, hs;
+  if (!parse_values(argv[arg+1], false, xs) || !parse_values(argv[arg+2], true, hs)
+      || functions.empty() || xs.empty() || hs.empty()) {
+      print_usage(argv[0]);
+      return 1;
+  }
+
+  FILE *file_ptr = out_file.empty() ? stdout : fopen(out_file.c_str(), "wb");
+  if (!file_ptr) {
+      cerr << "ERROR: Could not open " << out_file << endl;
+      return 1;
+  }
+  buffered_writer writer;
+  writer_open(&writer, file_ptr);
+
+  const int prec = 8; const int width = prec+7;
+  const char *const pad = "   ";
+  char line[256];
+  if (binary) {
+      const uint32_t header[2] = {1, (uint32_t) functions.size()};
+      writer_put(&writer, "DERIVSWP", 8);
+      writer_put(&writer, header, sizeof(header));
+      for (const function_entry *function: functions) {
+          char name[16] = {0};
+          strncpy(name, function->name, sizeof(name) - 1);
+          writer_put(&writer, name, sizeof(name));
+      }
+  }
+  else {
+      const int length = snprintf(line, sizeof(line),
+                                  "# log10(h) vs. log10(rel errs)\n"
+                                  "%-*s%s%-*s%s%-*s%s%-*s%s%-*s%s%-*s%s%-*s\n",
+                                  width, "function", pad, width, "x", pad, width, "h", pad,
+                                  width, "forward_diff", pad, width, "central_diff", pad,
+                                  width, "extrap_diff", pad, width, "extrap_diff2");
+      writer_put(&writer, line, length);
+  }
+
+  double alpha = 1.;		// a parameter for the functions
+  void *params_ptr = &alpha;
+  const int nh = hs.size();
+  const int block = 4096;	// x values per block
+  const int ncolumns = 7;
+  vector<double> rows((size_t) block * nh * ncolumns);
+
+  for (size_t f = 0; f < functions.size(); ++f) {
+      const function_entry *function = functions[f];
+      for (size_t first = 0; first < xs.size(); first += block) {
+          const int nx = min((size_t) block, xs.size() - first);
+
+          #ifdef OMP
+          #pragma omp parallel for schedule(static)
+          #endif
+          for (int i = 0; i < nx; ++i) {
+              const double x = xs[first + i];
+              const double answer = function->deriv(x, params_ptr);
+              vector<double> x_h(nh, x);
+              vector<diff_estimates> diffs(nh);
+              diff_batch(nh, x_h.data(), hs.data(), function->f_batch, params_ptr,
+                         diffs.data());
+
+              for (int j = 0; j < nh; ++j) {
+                  double *const row = &rows[((size_t) i*nh + j) * ncolumns];
+                  row[0] = f;
+                  row[1] = x;
+                  row[2] = log10(hs[j]);
+                  row[3] = log10(fabs((diffs[j].forward - answer) / answer));
+                  row[4] = log10(fabs((diffs[j].central - answer) / answer));
+                  row[5] = log10(fabs((diffs[j].extrap - answer) / answer));
+                  row[6] = log10(fabs((diffs[j].extrap2 - answer) / answer));
+              }
+          }
+
+          const size_t nrows = (size_t) nx * nh;
+          if (binary) {
+              writer_put(&writer, rows.data(), nrows * ncolumns * sizeof(double));
+              continue;
+          }
+          for (size_t r = 0; r < nrows; ++r) {
+              const double *const row = &rows[r * ncolumns];
+              int length = snprintf(line, sizeof(line), "%-*s", width, function->name);
+              for (int c = 1; c < ncolumns; ++c)
+                  length += snprintf(line + length, sizeof(line) - length, "%s%*.*e",
+                                     pad, width, prec, row[c]);
+              line[length++] = '\n';
+              writer_put(&writer, line, length);
+          }
+      }
+  }
+
+  writer_close(&writer);
+  if (file_ptr != stdout)
+      fclose(file_ptr);
+  return 0;
+}
+
+// A comma-separated list of values, or first:last:n (n evenly spaced)
+//  or, if halving, hmax:hmin (hmax, hmax/2, ... down to hmin); the
+//  values of a halving (step size) list must all be > 0
+bool parse_values(const string &list, bool halving, vector<double> &values) {
+  try {
+      if (list.find(':') == string::npos) {
+          istringstream items(list);
+          string item;
+          while (getline(items, item, ',')) {
+              const double value = stod(item);
+              if (halving && !(value > 0.))	// also rejects nan
+                  return false;
+              values.push_back(value);
+          }
+          return true;
+      }
+
+      istringstream items(list);
+      string first, last, count;
+      getline(items, first, ':');
+      getline(items, last, ':');
+      getline(items, count);
+      if (halving) {
+          const double hmax = stod(first), hmin = stod(last);
+          if (!count.empty() || hmin <= 0. || hmax < hmin)
+              return false;
+          for (double h = hmax; h >= hmin; h /= 2.)
+              values.push_back(h);
+          return true;
+      }
+      const double x0 = stod(first), x1 = stod(last);
+      const int n = stoi(count);
+      if (n < 1)
+          return false;
+      for (int i = 0; i < n; ++i)
+          values.push_back(n == 1 ? x0 : x0 + (x1 - x0) * i / (n - 1));
+      return true;
+  }
+  catch (const exception &) {
+      return false;
+  }
+}
+
+void print_usage(const char *program) {
+  cerr << "\nUsage: " << program << '\n'
+       << "   or: " << program << " [-o <file>] [-b] <functions> <x> <h>\n"
+       << "  -o  write to file instead of stdout\n"
+       << "  -b  write binary records instead of text\n"
+       << "functions, x and h are comma-separated lists; x may also be first:last:n\n"
+       << "and h hmax:hmin (halving); every h must be > 0; functions:";
+  for (int f = 0; f < nfunctions; ++f)
+      cerr << ' ' << function_table[f].name;
+  cerr << endl;
+}
+
+//************************** buffered_writer *********************
+// Gather output in a 1 MB buffer and write it to file_ptr when full
+void writer_open(buffered_writer *writer_ptr, FILE *file_ptr) {
+  writer_ptr->file_ptr = file_ptr;
+  writer_ptr->buffer.resize(1 << 20);
+  writer_ptr->used = 0;
+}
+
+void writer_put(buffered_writer *writer_ptr, const void *data, size_t size) {
+  if (writer_ptr->used + size > writer_ptr->buffer.size()) {
+      fwrite(writer_ptr->buffer.data(), 1, writer_ptr->used, writer_ptr->file_ptr);
+      writer_ptr->used = 0;
+  }
+  if (size > writer_ptr->buffer.size()) {
+      fwrite(data, 1, size, writer_ptr->file_ptr);
+      return;
+  }
+  memcpy(writer_ptr->buffer.data() + writer_ptr->used, data, size);
+  writer_ptr->used += size;
+}
+
+void writer_close(buffered_writer *writer_ptr) {
+  fwrite(writer_ptr->buffer.data(), 1, writer_ptr->used, writer_ptr->file_ptr);
+  writer_ptr->used = 0;
+  fflush(writer_ptr->file_ptr);
+}
@@ -12,6 +12,25 @@
 //      01/20/06  rearranged code to make it clearer
 //      03/28/19  Added output of eigenfunctions to file,
       //                exact Coulomb eigenfunction
+//      10/18/26  Integrate only the upper triangle of H, in parallel;
+//                per-element output only with -v
+//      10/18/26  Optional tabulated engine (-t): H from the basis
+//                functions on one shared quadrature grid
+//      10/18/26  Only the lowest states with -k
+//      10/18/26  Table of potentials (with Morse and a user-supplied
+//                one), parameters with -p, sweeps in one process
+//      10/18/26  One H per sweep group at the largest dimension;
+//                smaller bases diagonalize its leading block
+//      10/18/26  Wavefunctions as one matrix product on a grid set
+//                with -g
+//      10/18/26  Binary output (-b) and conversion to text (-c)
+//      10/18/26  One integration workspace per thread, instead of a
+//                new (never freed) one for every Hij
+//      10/18/26  Any l (-l), each channel solved as its own block
+//      10/18/26  Matrix element tolerances from a requested eigenvalue
+//                accuracy (-e), with a bound on the eigenvalue error
+//      10/18/26  GSL error handler off; a qagiu failure is reported
+//                and its error estimate still goes into the bound
 //
 //  Notes:
 //   * Based on the documentation for the GSL library under
@@ -33,12 +52,33 @@
 //      GSL_EIGEN_SORT_ABS_DESC => descending order in magnitude
 //   * We use gls_integration_qagiu for the integrals from
 //      0 to Infinity (calculating matrix elements of H).
-//   * Start with l=0 (and generalize later)
+//   * With -e, the integration error allowed for each Hij comes from
+//      the accuracy wanted for the eigenvalues, and the error estimates
+//      of the integrals are combined into a bound on that of every
+//      eigenvalue (see assemble_hamiltonian).
+//   * H is block diagonal in l, so each l channel (-l, default 0) is
+//      assembled and diagonalized on its own, in parallel with the
+//      others with OMP.
+//   * Only the upper triangle of the symmetric H is integrated, in
+//      parallel when compiled with -fopenmp -DOMP (make binaries_omp).
+//   * With -t, the basis functions and the potential are instead
+//      tabulated once on a composite Gauss-Legendre grid and H is
+//      formed with one matrix product (gsl_blas_dgemm).
+//   * With -k, only the k lowest eigenpairs are found (eigen_lowest
+//      in partial_eigen.cpp), skipping the accumulation of all the
+//      eigenvectors that makes gsl_eigen_symmv expensive.
+//   * The potentials are looked up by name or number in
+//      potential_table, each with default parameters.
+//   * Each of potential, b and dimension on the command line may be a
+//      comma-separated list; every combination is solved in the same
+//      process (in parallel with OMP), sharing the tabulated basis
+//      functions between runs with the same b.  Runs that differ only
+//      in dimension share H, assembled once for the largest one.
+//   * With -b, the results go to a binary file instead (see
+//      write_binary_header for the layout); -c turns one back into the
+//      usual text output.
 //
 //  To do:
-//   * Add the Morse potential (function is given but not incorporated)
-//   * Generalize to l>0.
-//   * Make potential selection less kludgy.
 //   * Improve efficiency (reduce run time)
 //   * Split into more files (?) or convert to classes
 //
@@ -48,36 +88,97 @@
 #include <iostream>		// note that .h is omitted
 #include <iomanip>		// note that .h is omitted
 #include <fstream>
-#include <functional>
 #include <string>
 #include <sstream>
 #include <cstring>
 #include <cmath>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
 using namespace std;
 
+#include <gsl/gsl_blas.h>	        // gsl matrix products
 #include <gsl/gsl_eigen.h>	        // gsl eigensystem routines
 #include <gsl/gsl_integration.h>	// gsl integration routines
+#include <gsl/gsl_errno.h>		// gsl error handler and codes
 #include <gsl/gsl_sf_gamma.h>
 #include <gsl/gsl_sf_laguerre.h>
 
 // structures and function prototypes
+typedef struct			// a potential tabulated in a file by the user
+{
+  vector<double> r;
+  vector<double> V;
+}
+user_potential;
+
+typedef struct			// structure holding potential parameters
+{
+  double param1;		// any three parameters
+  double param2;
+  double param3;
+  const user_potential *user_ptr;	// table for V_user
+}
+potential_parameters;
+
+typedef struct			// an entry in the table of potentials
+{
+  const char *name;
+  double (*V)(double r, potential_parameters * potl_params_ptr);
+  potential_parameters defaults;	// unless given with -p
+  int breakpoint_param;		// param where V jumps (1..3), 0 if none
+}
+potential_entry;
+
 typedef struct			// structure holding Hij parameters
 {
   int i;			// 1st matrix index
   int j;			// 2nd matrix index
+  int l;			// orbital angular momentum
   double mass;			// particle mass
   double b_ho;			// harmonic oscillator parameter
-  int potential_index;		// indicates which potential to use
+  const potential_entry *potential;	// which potential to use
+  potential_parameters potl_params;	// and its parameters
 }
 hij_parameters;
 
-typedef struct			// structure holding potential parameters
+typedef struct			// basis functions on a quadrature grid
 {
-  double param1;		// any three parameters
-  double param2;
-  double param3;
+  double b_ho;			// harmonic oscillator parameter
+  double breakpoint;		// grid panel boundary
+  vector<double> r;		// grid points
+  vector<double> weights;	// and quadrature weights
+  vector<gsl_matrix *> basis_ptrs;	// u_nl(r_k) for n = 1..rows, by l
 }
-potential_parameters;
+basis_table;
+
+typedef struct			// one point of a parameter sweep
+{
+  hij_parameters ho_parameters;
+  int dimension;		// of the basis
+  int nstates;			// lowest states wanted
+  gsl_vector *Eigval_ptr;	// results
+  gsl_matrix *Eigvec_ptr;
+  double error_bound;		// on every eigenvalue, < 0 if unknown
+}
+sweep_point;
+
+typedef struct			// the results for one point, as written out
+{
+  string potential;		// name
+  double params[3];		// param1..param3
+  double b_ho;
+  int l;
+  int dimension;
+  int nstates;
+  vector<double> eigenvalues;	// nstates
+  double error_bound;		// on every eigenvalue, < 0 if unknown
+  vector<double> eigenvectors;	// dimension x nstates, row by row
+  vector<double> r;		// wavefunction grid
+  vector<double> wf_exact;	// exact ground state on r, empty if unknown
+  vector<double> wf;		// nstates x r.size(), u(r)/r
+}
+result_block;
 
 double coulomb_wf_norm(int, int, double);
 double coulomb_wf_exact(int, int, double, double);
@@ -86,43 +187,122 @@ double coulomb_wf_exact(int, int, double, double);
 double V_coulomb(double r, potential_parameters * potl_params_ptr);
 double V_square_well(double r, potential_parameters * potl_params_ptr);
 double V_morse(double r, potential_parameters * potl_params_ptr);
+double V_user(double r, potential_parameters * potl_params_ptr);
+bool read_user_potential(const string &filename, user_potential *table_ptr);
+// where the potential is not smooth
+double V_breakpoint(const hij_parameters *ho_parameters_ptr);
+
+// all the potentials, with their default parameters
+const potential_entry potential_table[] = {
+  {"coulomb", V_coulomb, {1., 0., 0., NULL}, 0},		// Ze^2
+  {"square_well", V_square_well, {50., 1., 0., NULL}, 2},	// V0, R
+  {"morse", V_morse, {10., 2., 0., NULL}, 0},			// D_eq, r_eq
+  {"user", V_user, {1., 0., 0., NULL}, 0},			// scale (-u file)
+};
+const int npotentials = sizeof(potential_table) / sizeof(potential_table[0]);
+const potential_entry *find_potential(const string &name);
 
 // i'th-j'th matrix element of Hamiltonian in ho basis
-double Hij(hij_parameters ho_parameters);
+double Hij(hij_parameters ho_parameters, double abs_error, double rel_error,
+           double *error_ptr, int *status_ptr);
 double Hij_integrand(double x, void *params_ptr);
+// fill the whole Hamiltonian matrix
+void assemble_hamiltonian(gsl_matrix *Hmat_ptr, gsl_matrix *Herr_ptr,
+                          hij_parameters ho_parameters, double accuracy, bool verbose);
+// fill it from basis functions tabulated on a shared grid instead
+void assemble_hamiltonian_tabulated(gsl_matrix *Hmat_ptr, hij_parameters ho_parameters,
+                                    const basis_table *table_ptr, bool verbose);
+void basis_table_init(basis_table *table_ptr, double b_ho, double breakpoint,
+                      const vector<int> &dimensions);
+void basis_table_free(basis_table *table_ptr);
+void quadrature_grid(double breakpoint, double rmax, double panel_width,
+                     vector<double> &r, vector<double> &weights);
+void print_hamiltonian(const gsl_matrix *Hmat_ptr);
+// eigenfunctions on a grid from the eigenvectors
+void reconstruct_wavefunctions(const sweep_point *point_ptr, const vector<double> &r,
+                               gsl_matrix *wf_ptr);
+
+// output of the results, as text or binary
+void print_eigenvalues(const result_block &block, bool print_header);
+void write_text_block(const result_block &block, ofstream &wfunc_out,
+                      const string &wfunc_file, bool append);
+void write_binary_header(ostream &out, uint32_t nblocks);
+void write_binary_block(ostream &out, const result_block &block);
+bool read_binary_header(istream &in, uint32_t *nblocks_ptr);
+bool read_binary_block(istream &in, result_block *block_ptr);
+int convert_binary(const string &binary_file, const string &wfunc_file, bool append);
+
+// solve every point of a sweep
+void solve_sweep(vector<sweep_point> &points, bool tabulated, double accuracy, bool verbose);
+void solve_point(sweep_point *point_ptr, const gsl_matrix *Hgroup_ptr,
+                 const gsl_matrix *Herr_group_ptr);
+
+vector<string> split_list(const string &list);
+void print_usage(ostream &stream, const char *program);
 
 // harmonic oscillator routines from harmonic_oscillator.cpp
 extern double ho_radial(int n, int l, double b_ho, double r);
+extern void ho_radial_all(int nmax, int l, double b_ho, double r, double *u);
+extern void ho_radial_grid(int nmax, int l, double b_ho, int npoints, const double *r,
+                           double *u, int stride);
 extern double ho_eigenvalue(int n, int l, double b_ho, double mass);
 
+// partial spectrum from partial_eigen.cpp
+extern void eigen_lowest(gsl_matrix *Hmat_ptr, gsl_vector *Eigval_ptr,
+                         gsl_matrix *Eigvec_ptr);
+
 // to square numbers
 template<class T> inline T sqr(T x) { return x*x; }
 template<class T> inline T cube(T x) { return x*x*x; }
 
 //************************** main program ***************************
 int main(int argc, char **argv) {
-  hij_parameters ho_parameters;  // parameters for the Hamiltonian
-  double b_ho;			// ho length parameter
-  int dimension;		// dimension of the matrices and vectors
+  // A matrix element that misses its tolerance (GSL_EROUND,
+  //  GSL_EMAXITER, ...) is reported by assemble_hamiltonian rather
+  //  than aborting the whole run
+  gsl_set_error_handler_off();
+
   bool append = false;
-  string wfunc_file;
+  bool verbose = false;		// print every matrix element
+  bool tabulated = false;	// use the tabulated engine for H
+  int nstates = 0;		// number of lowest states wanted (0 = all)
+  double accuracy = 0.;		// wanted for the eigenvalues (0 = fixed
+				//  tolerance for each Hij instead)
+  int nr = 100;			// wavefunction grid: nr steps from rmin to rmax
+  double rmin = 0.01, rmax = 10.0;
+  string wfunc_file = "eigen_basis.dat";
+  string user_file;		// table for the user potential
+  string binary_file;		// results in binary instead (-b)
+  string convert_file;		// binary results to write as text (-c)
+  user_potential user_table;
+
+  // every combination of these is solved
+  vector<const potential_entry *> potentials;
+  vector<vector<double>> param_sets;	// leading params replacing the defaults
+  vector<int> l_values;		// orbital angular momenta
+  vector<double> b_values;	// ho length parameters
+  vector<int> dimensions;	// dimensions of the matrices and vectors
 
   if (argc == 1) {
     // pick the potential based on the integer "answer"
     int answer = 0;
-    while (answer != 1 && answer != 2) { // don't quit until 1 or 2!
-        cout << "Enter 1 for Coulomb or 2 for square well potential: ";
+    while (answer < 1 || answer > 3) { // don't quit until 1, 2 or 3!
+        cout << "Enter 1 for Coulomb, 2 for square well or 3 for Morse potential: ";
         cin >> answer;
     }
-    ho_parameters.potential_index = answer;
+    potentials.push_back(&potential_table[answer-1]);
 
     // Set up the harmonic oscillator basis
+    double b_ho;
     cout << "Enter the oscillator parameter b: ";
     cin >> b_ho;
+    b_values.push_back(b_ho);
 
     // pick the dimension of the basis (matrix)
+    int dimension;
     cout << "Enter the dimension of the basis: ";
     cin >> dimension;
+    dimensions.push_back(dimension);
 
     cin.ignore();
     do {
@@ -133,142 +313,211 @@ int main(int argc, char **argv) {
     if (wfunc_file.empty())
         wfunc_file = "eigen_basis.dat";
   }
-  else if (argc == 4) {
-    ho_parameters.potential_index = stoi(argv[1]);
-    b_ho = stod(argv[2]);
-    dimension = stoi(argv[3]);
-    wfunc_file = "eigen_basis.dat";
-  }
-  else if (argc == 6 && strcmp(argv[1], "-o") == 0) {
-    append = false;
-    wfunc_file = argv[2];
-    ho_parameters.potential_index = stoi(argv[3]);
-    b_ho = stod(argv[4]);
-    dimension = stoi(argv[5]);
+  else {
+    // Options first, then the positional arguments
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-'; ++arg) {
+        if (strcmp(argv[arg], "-h") == 0) {
+            print_usage(cout, argv[0]);
+            return 0;
+        }
+        else if ((strcmp(argv[arg], "-o") == 0 || strcmp(argv[arg], "-a") == 0) && arg+1 < argc) {
+            append = argv[arg][1] == 'a';
+            wfunc_file = argv[++arg];
+        }
+        else if (strcmp(argv[arg], "-v") == 0)
+            verbose = true;
+        else if (strcmp(argv[arg], "-t") == 0)
+            tabulated = true;
+        else if (strcmp(argv[arg], "-k") == 0 && arg+1 < argc)
+            nstates = stoi(argv[++arg]);
+        else if (strcmp(argv[arg], "-u") == 0 && arg+1 < argc)
+            user_file = argv[++arg];
+        else if (strcmp(argv[arg], "-e") == 0 && arg+1 < argc)
+            accuracy = stod(argv[++arg]);
+        else if (strcmp(argv[arg], "-l") == 0 && arg+1 < argc) {
+            for (const string &value: split_list(argv[++arg]))
+                l_values.push_back(stoi(value));
+        }
+        else if (strcmp(argv[arg], "-b") == 0 && arg+1 < argc)
+            binary_file = argv[++arg];
+        else if (strcmp(argv[arg], "-c") == 0 && arg+1 < argc)
+            convert_file = argv[++arg];
+        else if (strcmp(argv[arg], "-g") == 0 && arg+1 < argc) {
+            const vector<string> grid = split_list(argv[++arg]);
+            if (grid.size() != 3) {
+                print_usage(cerr, argv[0]);
+                return 1;
+            }
+            nr = stoi(grid[0]);
+            rmin = stod(grid[1]);
+            rmax = stod(grid[2]);
+            if (nr < 1 || rmin <= 0. || rmax <= rmin) {
+                cerr << "ERROR: The grid needs nr >= 1 and 0 < rmin < rmax" << endl;
+                return 1;
+            }
+        }
+        else if (strcmp(argv[arg], "-p") == 0 && arg+1 < argc) {
+            vector<double> params;
+            for (const string &value: split_list(argv[++arg]))
+                params.push_back(stod(value));
+            param_sets.push_back(params);
+        }
+        else
+            break;
+    }
+    if (!convert_file.empty()) {
+        if (arg != argc) {
+            print_usage(cerr, argv[0]);
+            return 1;
+        }
+        return convert_binary(convert_file, wfunc_file, append);
+    }
+    if (argc - arg != 3) {
+        print_usage(cerr, argv[0]);
+        return 1;
+    }
+    for (const string &name: split_list(argv[arg])) {
+        const potential_entry *potential = find_potential(name);
+        if (!potential) {
+            cerr << "ERROR: Unknown potential: " << name << endl;
+            print_usage(cerr, argv[0]);
+            return 1;
+        }
+        potentials.push_back(potential);
+    }
+    for (const string &value: split_list(argv[arg+1]))
+        b_values.push_back(stod(value));
+    for (const string &value: split_list(argv[arg+2]))
+        dimensions.push_back(stoi(value));
   }
-  else if (argc == 6 && strcmp(argv[1], "-a") == 0) {
-    append = true;
-    wfunc_file = argv[2];
-    ho_parameters.potential_index = stoi(argv[3]);
-    b_ho = stod(argv[4]);
-    dimension = stoi(argv[5]);
+
+  if (l_values.empty())
+      l_values.push_back(0);
+  for (int l: l_values) {
+      if (l < 0) {
+          cerr << "ERROR: l must be >= 0" << endl;
+          return 1;
+      }
   }
-  else {
-    cerr << "\nUsage: " << argv[0]
-         << " [-o|-a <wfunc_file=eigen_basis.dat>] <potential_index> <b_ho> <dimension>"
-         << endl;
-    return 1;
+
+  if (!user_file.empty() && !read_user_potential(user_file, &user_table)) {
+      cerr << "ERROR: Could not read a user potential from " << user_file << endl;
+      return 1;
   }
 
   double mass = 1;		 // measure mass in convenient units
-  ho_parameters.mass = mass;
-  ho_parameters.b_ho = b_ho;
 
-  // See the GSL documentation for matrix, vector structures
-  //  Define and allocate space for the vectors, matrices, and workspace
-                               // original gsl matrix with Hamiltonian
-  gsl_matrix *Hmat_ptr = gsl_matrix_alloc (dimension, dimension);
-                               // gsl vector with eigenvalues
-  gsl_vector *Eigval_ptr = gsl_vector_alloc (dimension);
-                               // gsl matrix with eigenvectors
-  gsl_matrix *Eigvec_ptr = gsl_matrix_alloc (dimension, dimension);
-                               // the workspace for gsl
-  gsl_eigen_symmv_workspace *worksp = gsl_eigen_symmv_alloc (dimension);
-
-  // Load the Hamiltonian matrix pointed to by Hmat_ptr
-  for (int i = 0; i < dimension; i++) {
-      for (int j = 0; j < dimension; j++) {
-          ho_parameters.i = i;
-          ho_parameters.j = j;
-          gsl_matrix_set(Hmat_ptr, i, j, Hij (ho_parameters));
-          // print statement for debugging
-          cout << "i = " << i << ", j = " << j
-            << ", Hij = " << Hij(ho_parameters) << endl;
+  // Lay out the sweep: potentials, then parameters, then l, then b,
+  //  then dimension
+  vector<sweep_point> points;
+  for (const potential_entry *potential: potentials) {
+      if (potential->V == V_user && user_table.r.empty()) {
+          cerr << "ERROR: The user potential needs a table given with -u" << endl;
+          return 1;
+      }
+      vector<potential_parameters> params;
+      for (const vector<double> &values: param_sets) {
+          potential_parameters potl_params = potential->defaults;
+          if (values.size() > 0) potl_params.param1 = values[0];
+          if (values.size() > 1) potl_params.param2 = values[1];
+          if (values.size() > 2) potl_params.param3 = values[2];
+          params.push_back(potl_params);
+      }
+      if (params.empty())
+          params.push_back(potential->defaults);
+      for (potential_parameters potl_params: params) {
+          potl_params.user_ptr = &user_table;
+          for (int l: l_values) {
+              for (double b_ho: b_values) {
+                  for (int dimension: dimensions) {
+                      sweep_point point;
+                      point.ho_parameters.l = l;
+                      point.ho_parameters.mass = mass;
+                      point.ho_parameters.b_ho = b_ho;
+                      point.ho_parameters.potential = potential;
+                      point.ho_parameters.potl_params = potl_params;
+                      point.dimension = dimension;
+                      point.nstates = nstates <= 0 || nstates > dimension ? dimension : nstates;
+                      points.push_back(point);
+                  }
+              }
+          }
       }
   }
 
-  // Find the eigenvalues and eigenvectors of the real, symmetric
-  //  matrix pointed to by Hmat_ptr.  It is partially destroyed
-  //  in the process. The eigenvectors are pointed to by
-  //  Eigvec_ptr and the eigenvalues by Eigval_ptr.
-  gsl_eigen_symmv(Hmat_ptr, Eigval_ptr, Eigvec_ptr, worksp);
-
-  // Sort the eigenvalues and eigenvectors in ascending order
-  gsl_eigen_symmv_sort(Eigval_ptr, Eigvec_ptr, GSL_EIGEN_SORT_VAL_ASC);
+  solve_sweep(points, tabulated, accuracy, verbose);
 
-  // Print out the results
-  // Allocate a pointer to one of the eigenvectors of the matrix
-  for (int i = 0; i < dimension; i++) {
-      double eigenvalue = gsl_vector_get(Eigval_ptr, i);
+  // The wavefunction grid, the same for every point: nr+1 points from
+  //  rmin to rmax, by index so that rounding can't drop or add rmax
+  vector<double> r_grid(nr + 1);
+  const double dr = (rmax-rmin)/nr;
+  for (int k = 0; k <= nr; k++)
+      r_grid[k] = rmin + k*dr;
 
-      cout << "eigenvalue " << i+1 << " = "
-           << scientific << eigenvalue << endl;
+  ofstream wfunc_out;
+  ofstream binary_out;
+  if (!binary_file.empty()) {
+      binary_out.open(binary_file, ofstream::out | ofstream::binary);
+      write_binary_header(binary_out, points.size());
   }
+  for (const sweep_point &point: points) {
+      const hij_parameters &ho_parameters = point.ho_parameters;
+      const potential_parameters &potl_params = ho_parameters.potl_params;
+      const int dimension = point.dimension;
+      const int nstates = point.nstates;
 
-  bool skip = false;
-  function<double(double)> exact_wf;
-  switch (ho_parameters.potential_index) {
-      case 1:
-          exact_wf = [mass](double x) { return coulomb_wf_exact(1, 0, x, mass); };
-          break;
-      case 2:
-          cerr << "WARNING: Exact square well potential unimplemented. Not outputting to file" << endl;
-          skip = true;
-          break;
-      default:
-          cerr << "ERROR: Invalid potential index: " << ho_parameters.potential_index << endl;
-          skip = true;
-  }
-
-  if (!skip) {
-      ofstream wfunc_out;
-      if (append) {
-          wfunc_out.open(wfunc_file, ofstream::out | ofstream::app);
-          wfunc_out << "\n\n";
+      result_block block;
+      block.potential = ho_parameters.potential->name;
+      block.params[0] = potl_params.param1;
+      block.params[1] = potl_params.param2;
+      block.params[2] = potl_params.param3;
+      block.b_ho = ho_parameters.b_ho;
+      block.l = ho_parameters.l;
+      block.dimension = dimension;
+      block.nstates = nstates;
+      block.eigenvalues.assign(point.Eigval_ptr->data, point.Eigval_ptr->data + nstates);
+      block.error_bound = point.error_bound;
+      block.eigenvectors.resize(dimension * nstates);
+      for (int j = 0; j < dimension; ++j) {
+          for (int i = 0; i < nstates; ++i)
+              block.eigenvectors[j*nstates + i] = gsl_matrix_get(point.Eigvec_ptr, j, i);
       }
-      else
-          wfunc_out.open(wfunc_file);
-      const int prec = 8;
-      const int width = prec+7;
-      const char *const pad = "   ";
-
-      wfunc_out << left
-                << setw(width) << 'x' << pad
-                << setw(width) << "wf_exact_0";
-      {
-          ostringstream wf_i("wf_");
-          for (int i = 0; i < dimension; ++i) {
-              wf_i.seekp(3);
-              wf_i << setprecision(2) << i << "_b=" << b_ho << ",dim=" << dimension;
-              wfunc_out << pad << setw(width) << wf_i.str();
-          }
-          wfunc_out << '\n';
+      block.r = r_grid;
+
+      if (ho_parameters.potential->V == V_coulomb) {
+          // the Bohr radius is 1/(m Ze^2); the lowest state with l
+          //  has n = l+1
+          const double Zesq_mass = potl_params.param1 * mass;
+          const int l = ho_parameters.l;
+          for (double r: r_grid)
+              block.wf_exact.push_back(coulomb_wf_exact(l+1, l, r, Zesq_mass));
       }
 
-      const int nr = 100;
-      const double rmin = 0.01, rmax = 10.0, dr = (rmax-rmin)/nr;
-
-      wfunc_out << right << scientific << setprecision(prec);
-      for (double r = rmin; r <= rmax; r += dr) {
-          wfunc_out << setw(width) << r << pad
-                    << setw(width) << exact_wf(r);
-          for (int i = 0; i < dimension; ++i) {
-              double wf_val = 0.0;
-              for (int j = 0; j < dimension; ++j) {
-                  wf_val += gsl_matrix_get(Eigvec_ptr, j, i)*ho_radial(j+1, 0, b_ho, r)/r;
-              }
-              wfunc_out << pad << setw(width) << wf_val;
-          }
-          wfunc_out << '\n';
+      gsl_matrix *wf_ptr = gsl_matrix_alloc(nstates, r_grid.size());
+      reconstruct_wavefunctions(&point, r_grid, wf_ptr);
+      block.wf.resize(nstates * r_grid.size());
+      for (int i = 0; i < nstates; ++i) {
+          for (size_t k = 0; k < r_grid.size(); ++k)
+              block.wf[i*r_grid.size() + k] = gsl_matrix_get(wf_ptr, i, k)/r_grid[k];
       }
-      wfunc_out.close();
+      gsl_matrix_free(wf_ptr);
+
+      // Print out the results
+      print_eigenvalues(block, points.size() > 1);
+      if (binary_out.is_open())
+          write_binary_block(binary_out, block);
+      else
+          write_text_block(block, wfunc_out, wfunc_file, append);
   }
+  binary_out.close();
+  wfunc_out.close();
 
-  // free the space used by the vector and matrices  and workspace
-  gsl_matrix_free(Eigvec_ptr);
-  gsl_vector_free(Eigval_ptr);
-  gsl_matrix_free(Hmat_ptr);
-  gsl_eigen_symmv_free (worksp);
+  // free the space used by the vectors and matrices
+  for (sweep_point &point: points) {
+      gsl_matrix_free(point.Eigvec_ptr);
+      gsl_vector_free(point.Eigval_ptr);
+  }
 
   return 0;			// successful completion
 }
@@ -285,6 +534,773 @@ double coulomb_wf_exact(int n, int l, double r, double mass) {
     return l == 0 ? partial : partial*pow(rho, l);
 }
 
+// Split a comma-separated list
+vector<string> split_list(const string &list) {
+    vector<string> items;
+    istringstream stream(list);
+    string item;
+    while (getline(stream, item, ','))
+        items.push_back(item);
+    return items;
+}
+
+void print_usage(ostream &stream, const char *program) {
+    stream << "\nUsage: " << program
+         << " [-v] [-t] [-e <accuracy>] [-k <nstates>] [-l <l>] [-p <param1,...>]... [-u <potential_file>]"
+         << " [-g <nr,rmin,rmax>] [-o|-a <wfunc_file=eigen_basis.dat>] [-b <binary_file>]"
+         << " <potentials> <b_ho> <dimension>\n"
+         << "   or: " << program << " [-o|-a <wfunc_file=eigen_basis.dat>] -c <binary_file>\n"
+         << "  -h  print this help\n"
+         << "  -v  print every matrix element of H\n"
+         << "  -t  compute H from basis functions tabulated on a shared grid\n"
+         << "  -e  integrate each Hij only as accurately as the eigenvalues need\n"
+         << "  -k  find only the nstates lowest eigenpairs\n"
+         << "  -l  orbital angular momentum (default 0); a list solves each channel\n"
+         << "  -p  leading potential parameters, replacing the defaults; repeat to sweep\n"
+         << "  -u  two-column file r V(r) for the user potential\n"
+         << "  -g  wavefunction grid of nr steps from rmin to rmax (default 100,0.01,10)\n"
+         << "  -o  write the wavefunctions to wfunc_file, -a appends to it\n"
+         << "  -b  write all the results to binary_file instead\n"
+         << "  -c  print the results in binary_file and write them to wfunc_file\n"
+         << "potentials, b_ho and dimension may be comma-separated lists to sweep over;\n"
+         << "potentials are given by name or number:";
+    for (int i = 0; i < npotentials; ++i)
+        stream << ' ' << i+1 << '=' << potential_table[i].name;
+    stream << endl;
+}
+
+//************************************************************
+
+//************************** print_eigenvalues ***************************
+//
+// Print the eigenvalues of one point to cout, preceded by what the
+//  point is if print_header (for a sweep).
+//
+//*****************************************************************
+void print_eigenvalues(const result_block &block, bool print_header) {
+    if (print_header) {
+        cout << defaultfloat << "\npotential = " << block.potential
+             << " (" << block.params[0] << ", " << block.params[1] << ", "
+             << block.params[2] << "), l = " << block.l << ", b = " << block.b_ho
+             << ", dimension = " << block.dimension << endl;
+    }
+    for (int i = 0; i < block.nstates; i++) {
+        double eigenvalue = block.eigenvalues[i];
+
+        cout << "eigenvalue " << i+1 << " = "
+             << scientific << eigenvalue << endl;
+    }
+    if (block.error_bound >= 0.)
+        cout << "eigenvalue error bound = " << scientific << block.error_bound << endl;
+}
+
+//************************************************************
+
+//************************** write_text_block ***************************
+//
+// Write the wavefunctions of one point as columns next to the exact
+//  one, to wfunc_out.  The first block opens wfunc_file, replacing it
+//  unless appending; blocks are separated by two blank lines.  Points
+//  without an exact wavefunction are skipped with a warning.
+//
+//*****************************************************************
+void write_text_block(const result_block &block, ofstream &wfunc_out,
+                      const string &wfunc_file, bool append)
+{
+    if (block.wf_exact.empty()) {
+        cerr << "WARNING: Exact " << block.potential
+             << " wavefunction unimplemented. Not outputting to file" << endl;
+        return;
+    }
+
+    if (!wfunc_out.is_open()) {
+        if (append) {
+            wfunc_out.open(wfunc_file, ofstream::out | ofstream::app);
+            wfunc_out << "\n\n";
+        }
+        else
+            wfunc_out.open(wfunc_file);
+    }
+    else
+        wfunc_out << "\n\n";
+    const int prec = 8;
+    const int width = prec+7;
+    const char *const pad = "   ";
+    const size_t npoints = block.r.size();
+
+    wfunc_out << left << defaultfloat
+              << setw(width) << 'x' << pad
+              << setw(width) << "wf_exact_0";
+    {
+        ostringstream wf_i("wf_");
+        for (int i = 0; i < block.nstates; ++i) {
+            wf_i.seekp(3);
+            wf_i << setprecision(2) << i << '_';
+            if (block.l != 0)
+                wf_i << "l=" << block.l << ',';
+            wf_i << "b=" << block.b_ho << ",dim=" << block.dimension;
+            wfunc_out << pad << setw(width) << wf_i.str();
+        }
+        wfunc_out << '\n';
+    }
+
+    wfunc_out << right << scientific << setprecision(prec);
+    for (size_t k = 0; k < npoints; ++k) {
+        wfunc_out << setw(width) << block.r[k] << pad
+                  << setw(width) << block.wf_exact[k];
+        for (int i = 0; i < block.nstates; ++i)
+            wfunc_out << pad << setw(width) << block.wf[i*npoints + k];
+        wfunc_out << '\n';
+    }
+}
+
+//************************************************************
+
+//************************** binary output ***************************
+//
+// Layout of a binary results file, all little-endian, with every
+//  array 8-byte aligned so that a reader can map the file and use the
+//  arrays in place:
+//     file header (16 bytes):
+//        char     magic[8]        "EIGBASIS"
+//        uint32   version         3
+//        uint32   nblocks
+//     then nblocks blocks, each an 80-byte header
+//        char     potential[16]   name, NUL padded
+//        double   params[3]
+//        double   b_ho
+//        double   error_bound     on the eigenvalues, < 0 if unknown
+//        uint32   dimension, nstates, npoints, has_exact, l, 0
+//     followed by the columns
+//        double   eigenvalues[nstates]
+//        double   eigenvectors[dimension][nstates]
+//        double   r[npoints]
+//        double   wf_exact[npoints]          (only if has_exact)
+//        double   wf[nstates][npoints]       u(r)/r
+//  The blocks are written one at a time as the points are done, so
+//  the file can be read as a stream as well.
+//
+//*****************************************************************
+const char binary_magic[8] = {'E', 'I', 'G', 'B', 'A', 'S', 'I', 'S'};
+const uint32_t binary_version = 3;
+const int binary_name_length = 16;
+
+// Write/read n values in little-endian byte order
+template<class T> void write_le(ostream &out, const T *data, size_t n) {
+    const uint16_t probe = 1;
+    if (*(const char *) &probe) {
+        out.write((const char *) data, n * sizeof(T));
+        return;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        char bytes[sizeof(T)];
+        memcpy(bytes, &data[i], sizeof(T));
+        reverse(bytes, bytes + sizeof(T));
+        out.write(bytes, sizeof(T));
+    }
+}
+template<class T> bool read_le(istream &in, T *data, size_t n) {
+    if (!in.read((char *) data, n * sizeof(T)))
+        return false;
+    const uint16_t probe = 1;
+    if (!*(const char *) &probe) {
+        for (size_t i = 0; i < n; ++i) {
+            char *const bytes = (char *) &data[i];
+            reverse(bytes, bytes + sizeof(T));
+        }
+    }
+    return true;
+}
+
+void write_binary_header(ostream &out, uint32_t nblocks) {
+    out.write(binary_magic, sizeof(binary_magic));
+    write_le(out, &binary_version, 1);
+    write_le(out, &nblocks, 1);
+}
+
+void write_binary_block(ostream &out, const result_block &block) {
+    char name[binary_name_length] = {0};
+    strncpy(name, block.potential.c_str(), binary_name_length - 1);
+    out.write(name, binary_name_length);
+    write_le(out, block.params, 3);
+    write_le(out, &block.b_ho, 1);
+    write_le(out, &block.error_bound, 1);
+    const uint32_t sizes[6] = {(uint32_t) block.dimension, (uint32_t) block.nstates,
+                               (uint32_t) block.r.size(), !block.wf_exact.empty(),
+                               (uint32_t) block.l, 0};
+    write_le(out, sizes, 6);
+
+    write_le(out, block.eigenvalues.data(), block.eigenvalues.size());
+    write_le(out, block.eigenvectors.data(), block.eigenvectors.size());
+    write_le(out, block.r.data(), block.r.size());
+    write_le(out, block.wf_exact.data(), block.wf_exact.size());
+    write_le(out, block.wf.data(), block.wf.size());
+}
+
+bool read_binary_header(istream &in, uint32_t *nblocks_ptr) {
+    char magic[sizeof(binary_magic)];
+    uint32_t version;
+    return in.read(magic, sizeof(magic)) && memcmp(magic, binary_magic, sizeof(magic)) == 0
+           && read_le(in, &version, 1) && version == binary_version
+           && read_le(in, nblocks_ptr, 1);
+}
+
+bool read_binary_block(istream &in, result_block *block_ptr) {
+    char name[binary_name_length];
+    uint32_t sizes[6];
+    if (!in.read(name, binary_name_length) || !read_le(in, block_ptr->params, 3)
+        || !read_le(in, &block_ptr->b_ho, 1) || !read_le(in, &block_ptr->error_bound, 1)
+        || !read_le(in, sizes, 6))
+        return false;
+    name[binary_name_length - 1] = '\0';
+    block_ptr->potential = name;
+    block_ptr->l = sizes[4];
+    block_ptr->dimension = sizes[0];
+    block_ptr->nstates = sizes[1];
+    const size_t npoints = sizes[2];
+
+    block_ptr->eigenvalues.resize(sizes[1]);
+    block_ptr->eigenvectors.resize((size_t) sizes[0] * sizes[1]);
+    block_ptr->r.resize(npoints);
+    block_ptr->wf_exact.resize(sizes[3] ? npoints : 0);
+    block_ptr->wf.resize(sizes[1] * npoints);
+    return read_le(in, block_ptr->eigenvalues.data(), block_ptr->eigenvalues.size())
+           && read_le(in, block_ptr->eigenvectors.data(), block_ptr->eigenvectors.size())
+           && read_le(in, block_ptr->r.data(), npoints)
+           && read_le(in, block_ptr->wf_exact.data(), block_ptr->wf_exact.size())
+           && read_le(in, block_ptr->wf.data(), block_ptr->wf.size());
+}
+
+//************************************************************
+
+//************************** convert_binary ***************************
+//
+// Print the eigenvalues in binary_file and write its wavefunctions to
+//  wfunc_file, exactly as the run that made it would have without -b.
+//
+//*****************************************************************
+int convert_binary(const string &binary_file, const string &wfunc_file, bool append) {
+    ifstream binary_in(binary_file, ifstream::in | ifstream::binary);
+    uint32_t nblocks;
+    if (!read_binary_header(binary_in, &nblocks)) {
+        cerr << "ERROR: " << binary_file << " is not an eigen_basis binary file" << endl;
+        return 1;
+    }
+
+    ofstream wfunc_out;
+    result_block block;
+    for (uint32_t b = 0; b < nblocks; ++b) {
+        if (!read_binary_block(binary_in, &block)) {
+            cerr << "ERROR: " << binary_file << " is truncated" << endl;
+            return 1;
+        }
+        print_eigenvalues(block, nblocks > 1);
+        write_text_block(block, wfunc_out, wfunc_file, append);
+    }
+    wfunc_out.close();
+
+    return 0;
+}
+
+//************************************************************
+
+//************************** solve_sweep ***************************
+//
+// Find the eigenvalues and eigenvectors at every point of the sweep.
+//   * The points that differ only in dimension share one H: the
+//      d x d matrix is the leading block of the (d+1) x (d+1) one,
+//      since the matrix elements do not depend on the size of the
+//      basis.  So H is assembled once per group, at the largest
+//      dimension, and a convergence study in the basis size costs
+//      about the largest run instead of the sum of all of them.
+//   * Each l channel is a group of its own.
+//   * With tabulated, one quadrature grid is made for each distinct
+//      (b, breakpoint) and the basis functions of every l are
+//      tabulated on it once, for the largest dimension that needs
+//      them; smaller bases use the leading rows.
+//   * With the adaptive integrals, the error estimates of the matrix
+//      elements are kept alongside H, for the eigenvalue error bound
+//      of each point (see solve_point); accuracy is passed on to
+//      assemble_hamiltonian.
+//   * The groups are assembled and the points solved in parallel
+//      (with OMP), except with verbose, which prints H as it goes.
+//      A single group keeps the threads for the matrix elements.
+//
+//*****************************************************************
+void solve_sweep(vector<sweep_point> &points, bool tabulated, double accuracy, bool verbose) {
+    vector<basis_table> tables;
+    vector<int> table_index;
+    vector<vector<int>> table_rows;	// rows of each table by l
+
+    // Group the points by everything but the dimension
+    vector<int> group_index(points.size());
+    vector<int> group_rows;
+    vector<size_t> group_first;		// a point of each group
+    for (size_t p = 0; p < points.size(); ++p) {
+        const hij_parameters &ho_parameters = points[p].ho_parameters;
+        size_t g = 0;
+        for (; g < group_first.size(); ++g) {
+            const hij_parameters &other = points[group_first[g]].ho_parameters;
+            if (other.potential == ho_parameters.potential
+                && other.l == ho_parameters.l
+                && other.b_ho == ho_parameters.b_ho
+                && other.potl_params.param1 == ho_parameters.potl_params.param1
+                && other.potl_params.param2 == ho_parameters.potl_params.param2
+                && other.potl_params.param3 == ho_parameters.potl_params.param3)
+                break;
+        }
+        if (g == group_first.size()) {
+            group_first.push_back(p);
+            group_rows.push_back(0);
+        }
+        group_index[p] = g;
+        group_rows[g] = max(group_rows[g], points[p].dimension);
+    }
+
+    if (tabulated) {
+        table_index.resize(group_first.size());
+        for (size_t g = 0; g < group_first.size(); ++g) {
+            const hij_parameters *ho_parameters_ptr = &points[group_first[g]].ho_parameters;
+            const double b_ho = ho_parameters_ptr->b_ho;
+            const double breakpoint = V_breakpoint(ho_parameters_ptr);
+            size_t t = 0;
+            while (t < tables.size()
+                   && !(tables[t].b_ho == b_ho && tables[t].breakpoint == breakpoint))
+                ++t;
+            if (t == tables.size()) {
+                tables.emplace_back();
+                tables[t].b_ho = b_ho;
+                tables[t].breakpoint = breakpoint;
+                table_rows.emplace_back();
+            }
+            table_index[g] = t;
+            const int l = ho_parameters_ptr->l;
+            if ((int) table_rows[t].size() <= l)
+                table_rows[t].resize(l + 1, 0);
+            table_rows[t][l] = max(table_rows[t][l], group_rows[g]);
+        }
+
+        #ifdef OMP
+        #pragma omp parallel for schedule(dynamic, 1)
+        #endif
+        for (size_t t = 0; t < tables.size(); ++t)
+            basis_table_init(&tables[t], tables[t].b_ho, tables[t].breakpoint, table_rows[t]);
+    }
+
+    // Load the Hamiltonian matrix of each group
+    vector<gsl_matrix *> group_H(group_first.size());
+    vector<gsl_matrix *> group_Herr(group_first.size(), NULL);	// error estimates
+    #ifdef OMP
+    #pragma omp parallel for schedule(dynamic, 1) if(group_first.size() > 1 && !verbose)
+    #endif
+    for (size_t g = 0; g < group_first.size(); ++g) {
+        group_H[g] = gsl_matrix_alloc(group_rows[g], group_rows[g]);
+        const hij_parameters &ho_parameters = points[group_first[g]].ho_parameters;
+        if (tabulated)
+            assemble_hamiltonian_tabulated(group_H[g], ho_parameters, &tables[table_index[g]],
+                                           verbose);
+        else {
+            group_Herr[g] = gsl_matrix_alloc(group_rows[g], group_rows[g]);
+            assemble_hamiltonian(group_H[g], group_Herr[g], ho_parameters, accuracy, verbose);
+        }
+    }
+
+    for (basis_table &table: tables)
+        basis_table_free(&table);
+
+    #ifdef OMP
+    #pragma omp parallel for schedule(dynamic, 1) if(points.size() > 1)
+    #endif
+    for (size_t p = 0; p < points.size(); ++p)
+        solve_point(&points[p], group_H[group_index[p]], group_Herr[group_index[p]]);
+
+    for (size_t g = 0; g < group_first.size(); ++g) {
+        gsl_matrix_free(group_H[g]);
+        if (group_Herr[g])
+            gsl_matrix_free(group_Herr[g]);
+    }
+}
+
+//************************************************************
+
+//************************** solve_point ***************************
+//
+// Diagonalize H for one point of the sweep, the leading dimension x
+//  dimension block of the matrix pointed to by Hgroup_ptr, leaving
+//  the point's nstates lowest eigenvalues and eigenvectors in newly
+//  allocated Eigval_ptr and Eigvec_ptr.
+//   * If Herr_group_ptr is not NULL, it holds the error estimates of
+//      the matrix elements, E.  The computed H is the exact one plus
+//      a symmetric perturbation no larger than E, so by Weyl's
+//      inequality no eigenvalue moves by more than its norm, which is
+//      at most the Frobenius norm of E over the block: that is the
+//      point's error_bound.
+//
+//*****************************************************************
+void solve_point(sweep_point *point_ptr, const gsl_matrix *Hgroup_ptr,
+                 const gsl_matrix *Herr_group_ptr)
+{
+  const int dimension = point_ptr->dimension;
+  const int nstates = point_ptr->nstates;
+
+  // See the GSL documentation for matrix, vector structures
+  //  Define and allocate space for the vectors, matrices, and workspace
+                               // original gsl matrix with Hamiltonian
+  gsl_matrix *Hmat_ptr = gsl_matrix_alloc (dimension, dimension);
+                               // gsl vector with eigenvalues
+  gsl_vector *Eigval_ptr = gsl_vector_alloc (nstates);
+                               // gsl matrix with eigenvectors
+  gsl_matrix *Eigvec_ptr = gsl_matrix_alloc (dimension, nstates);
+
+  // Load the Hamiltonian matrix pointed to by Hmat_ptr; the solvers
+  //  destroy it, so each point works on its own copy
+  gsl_matrix_const_view Hblock = gsl_matrix_const_submatrix(Hgroup_ptr, 0, 0,
+                                                            dimension, dimension);
+  gsl_matrix_memcpy(Hmat_ptr, &Hblock.matrix);
+
+  if (nstates < dimension) {
+      // Only the nstates lowest, already in ascending order; H is
+      //  destroyed as with gsl_eigen_symmv
+      eigen_lowest(Hmat_ptr, Eigval_ptr, Eigvec_ptr);
+  }
+  else {
+      // the workspace for gsl
+      gsl_eigen_symmv_workspace *worksp = gsl_eigen_symmv_alloc (dimension);
+
+      // Find the eigenvalues and eigenvectors of the real, symmetric
+      //  matrix pointed to by Hmat_ptr.  It is partially destroyed
+      //  in the process. The eigenvectors are pointed to by
+      //  Eigvec_ptr and the eigenvalues by Eigval_ptr.
+      gsl_eigen_symmv(Hmat_ptr, Eigval_ptr, Eigvec_ptr, worksp);
+
+      // Sort the eigenvalues and eigenvectors in ascending order
+      gsl_eigen_symmv_sort(Eigval_ptr, Eigvec_ptr, GSL_EIGEN_SORT_VAL_ASC);
+
+      gsl_eigen_symmv_free (worksp);
+  }
+
+  gsl_matrix_free(Hmat_ptr);
+
+  point_ptr->Eigval_ptr = Eigval_ptr;
+  point_ptr->Eigvec_ptr = Eigvec_ptr;
+
+  point_ptr->error_bound = -1.;
+  if (Herr_group_ptr) {
+      double sum = 0.;
+      for (int i = 0; i < dimension; ++i) {
+          for (int j = 0; j < dimension; ++j)
+              sum += sqr(gsl_matrix_get(Herr_group_ptr, i, j));
+      }
+      point_ptr->error_bound = sqrt(sum);
+  }
+}
+
+//************************************************************
+
+//********************** assemble_hamiltonian **********************
+//
+// Fill the dimension x dimension matrix pointed to by Hmat_ptr with
+//  the matrix elements Hij.
+//   * H is symmetric, so only the upper triangle is integrated and
+//      each element is mirrored into the lower one.
+//   * The cost of an element grows with n_i + n_j (more nodes in the
+//      integrand), so the elements are handed out most expensive first
+//      to whichever thread is free next (OpenMP dynamic schedule) when
+//      compiled with OMP; the cheap ones at the end even out the load.
+//   * The error estimate qagiu returns for each element goes into
+//      Herr_ptr, also for an element that missed its tolerance, so
+//      the bound of solve_point holds either way; the number of such
+//      elements is reported on cerr.
+//   * With accuracy > 0, each element is integrated only to the
+//      absolute error accuracy w_ij, with weights
+//         w_ij = 1 / ((1 + |i-j|) sqrt(S)),  sum_ij w_ij^2 = 1.
+//      Then the Frobenius norm of the errors, which bounds the error
+//      of every eigenvalue (see solve_point), stays below accuracy,
+//      also for any leading block.  The elements far from the
+//      diagonal, which couple states of very different energy and
+//      move the low eigenvalues least, get the looser tolerances.
+//      A relative tolerance of 1e-12 is kept as a floor, so large
+//      elements don't ask for more digits than a double has.
+//      Otherwise every element gets the fixed 1e-8 of the original.
+//   * With verbose, the elements are printed afterwards in row order.
+//
+//*****************************************************************
+void assemble_hamiltonian(gsl_matrix *Hmat_ptr, gsl_matrix *Herr_ptr,
+                          hij_parameters ho_parameters, double accuracy, bool verbose)
+{
+    const int dimension = Hmat_ptr->size1;
+
+    double weight_sum = dimension;	// S, the sum of (1 + |i-j|)^-2
+    for (int k = 1; k < dimension; ++k)
+        weight_sum += 2. * (dimension - k) / sqr(1. + k);
+
+    vector<pair<int, int>> elements;
+    elements.reserve(dimension*(dimension+1)/2);
+    for (int i = 0; i < dimension; ++i) {
+        for (int j = i; j < dimension; ++j)
+            elements.emplace_back(i, j);
+    }
+    stable_sort(elements.begin(), elements.end(),
+                [](const pair<int, int> &a, const pair<int, int> &b) {
+                    return a.first + a.second > b.first + b.second;
+                });
+
+    int failures = 0;		// elements that missed their tolerance
+    int failure_status = GSL_SUCCESS;	// the status of one of them
+    #ifdef OMP
+    #pragma omp parallel for schedule(dynamic, 1) firstprivate(ho_parameters) \
+                             reduction(+:failures)
+    #endif
+    for (size_t k = 0; k < elements.size(); ++k) {
+        ho_parameters.i = elements[k].first;
+        ho_parameters.j = elements[k].second;
+        double abs_error = 1.0e-8, rel_error = 1.0e-8;
+        if (accuracy > 0.) {
+            abs_error = accuracy
+                        / ((1. + abs(ho_parameters.i - ho_parameters.j)) * sqrt(weight_sum));
+            rel_error = 1.0e-12;
+        }
+        double error;
+        int status;
+        const double hij = Hij(ho_parameters, abs_error, rel_error, &error, &status);
+        if (status != GSL_SUCCESS) {
+            ++failures;
+            #ifdef OMP
+            #pragma omp atomic write
+            #endif
+            failure_status = status;
+        }
+        gsl_matrix_set(Hmat_ptr, ho_parameters.i, ho_parameters.j, hij);
+        gsl_matrix_set(Hmat_ptr, ho_parameters.j, ho_parameters.i, hij);
+        gsl_matrix_set(Herr_ptr, ho_parameters.i, ho_parameters.j, error);
+        gsl_matrix_set(Herr_ptr, ho_parameters.j, ho_parameters.i, error);
+    }
+
+    if (failures > 0) {
+        cerr << "WARNING: " << failures << " matrix elements missed their tolerance ("
+             << gsl_strerror(failure_status) << "); their error estimates are in the bound"
+             << endl;
+    }
+
+    if (verbose)
+        print_hamiltonian(Hmat_ptr);
+}
+
+//************************************************************
+
+//***************** assemble_hamiltonian_tabulated *****************
+//
+// Same as assemble_hamiltonian, but without an adaptive integral
+//  per element.  With the HO S-eqn used as in Hij_integrand,
+//     H_ij = E_i delta_ij + \int dr u_i(r) [V(r) - V_ho(r)] u_j(r),
+//  so on a quadrature grid r_k with weights w_k
+//     H = diag(E) + B diag(w (V - V_ho)) B^T,   B_nk = u_n(r_k).
+//   * B comes from the table pointed to by table_ptr (the leading
+//      dimension rows for l), so it is shared by every H with the
+//      same b and l;
+//      only the potential is tabulated here.  The O(dimension^2)
+//      integrals become one dgemm.
+//
+//*****************************************************************
+void assemble_hamiltonian_tabulated(gsl_matrix *Hmat_ptr, hij_parameters ho_parameters,
+                                    const basis_table *table_ptr, bool verbose)
+{
+    const int dimension = Hmat_ptr->size1;
+    const int l = ho_parameters.l;
+    const double mass = ho_parameters.mass;
+    const double b_ho = ho_parameters.b_ho;
+    const double omega = 1. / (mass * b_ho * b_ho);	// hbar = 1
+    const vector<double> &r = table_ptr->r;
+    const int npoints = r.size();
+
+    gsl_matrix_const_view basis
+      = gsl_matrix_const_submatrix(table_ptr->basis_ptrs[l], 0, 0, dimension, npoints);
+    gsl_matrix *weighted_ptr = gsl_matrix_alloc(dimension, npoints);
+
+    vector<double> wV(npoints);
+    for (int k = 0; k < npoints; ++k) {
+        const double ho_pot = (1. / 2.) * mass * sqr(omega * r[k]);
+        wV[k] = table_ptr->weights[k]
+                * (ho_parameters.potential->V(r[k], &ho_parameters.potl_params) - ho_pot);
+    }
+
+    #ifdef OMP
+    #pragma omp parallel for schedule(static)
+    #endif
+    for (int n = 0; n < dimension; ++n) {
+        const double *const u = gsl_matrix_const_ptr(&basis.matrix, n, 0);
+        double *const wu = gsl_matrix_ptr(weighted_ptr, n, 0);
+        for (int k = 0; k < npoints; ++k)
+            wu[k] = wV[k] * u[k];
+    }
+
+    gsl_blas_dgemm(CblasNoTrans, CblasTrans, 1.0, weighted_ptr, &basis.matrix, 0.0, Hmat_ptr);
+
+    // Add the HO energies and make H exactly symmetric
+    for (int i = 0; i < dimension; ++i) {
+        *gsl_matrix_ptr(Hmat_ptr, i, i) += ho_eigenvalue(i+1, l, b_ho, mass);
+        for (int j = i+1; j < dimension; ++j)
+            gsl_matrix_set(Hmat_ptr, j, i, gsl_matrix_get(Hmat_ptr, i, j));
+    }
+
+    gsl_matrix_free(weighted_ptr);
+
+    if (verbose)
+        print_hamiltonian(Hmat_ptr);
+}
+
+//************************************************************
+
+//********************** basis_table_init **********************
+//
+// Tabulate u_nl for n = 1..dimensions[l] on one grid for oscillator
+//  parameter b_ho with a panel boundary at breakpoint (no table for
+//  an l with dimensions[l] = 0).
+//   * The grid extends 6 b past the classical turning point of the
+//      highest state of any l and its panels are narrow enough to
+//      resolve its oscillations; see quadrature_grid.
+//   * basis_table_free releases it.
+//
+//*************************************************************
+void basis_table_init(basis_table *table_ptr, double b_ho, double breakpoint,
+                      const vector<int> &dimensions)
+{
+    // q^2 = 2(2(n-1) + l + 3/2) at the turning point of state n
+    double rmax = 0.;
+    int max_dimension = 1;
+    for (size_t l = 0; l < dimensions.size(); ++l) {
+        if (dimensions[l] > 0) {
+            rmax = max(rmax, b_ho * (sqrt(4.*dimensions[l] + 2.*l - 1.) + 6.));
+            max_dimension = max(max_dimension, dimensions[l]);
+        }
+    }
+    const double panel_width = b_ho * min(1., 2./sqrt((double) max_dimension));
+
+    table_ptr->b_ho = b_ho;
+    table_ptr->breakpoint = breakpoint;
+    quadrature_grid(breakpoint, rmax, panel_width, table_ptr->r, table_ptr->weights);
+
+    const int npoints = table_ptr->r.size();
+    table_ptr->basis_ptrs.assign(dimensions.size(), NULL);
+    for (size_t l = 0; l < dimensions.size(); ++l) {
+        if (dimensions[l] == 0)
+            continue;
+        gsl_matrix *basis_ptr = gsl_matrix_alloc(dimensions[l], npoints);
+        ho_radial_grid(dimensions[l], l, b_ho, npoints, table_ptr->r.data(),
+                       basis_ptr->data, basis_ptr->tda);
+        table_ptr->basis_ptrs[l] = basis_ptr;
+    }
+}
+
+void basis_table_free(basis_table *table_ptr) {
+    for (gsl_matrix *basis_ptr: table_ptr->basis_ptrs) {
+        if (basis_ptr)
+            gsl_matrix_free(basis_ptr);
+    }
+    table_ptr->basis_ptrs.clear();
+}
+
+//************************************************************
+
+//********************** quadrature_grid **********************
+//
+// Composite 16-point Gauss-Legendre grid on [0, rmax] with panels
+//  no wider than panel_width.  No panel straddles breakpoint (where
+//  the potential jumps), so the rule stays accurate there; pass 0
+//  for a smooth potential.
+//
+//*************************************************************
+void quadrature_grid(double breakpoint, double rmax, double panel_width,
+                     vector<double> &r, vector<double> &weights)
+{
+    const int order = 16;
+    gsl_integration_fixed_workspace *rule_ptr
+      = gsl_integration_fixed_alloc(gsl_integration_fixed_legendre, order, 0., 1., 0., 0.);
+    const double *nodes = gsl_integration_fixed_nodes(rule_ptr);
+    const double *rule_weights = gsl_integration_fixed_weights(rule_ptr);
+
+    const double ends[] = {0., min(max(breakpoint, 0.), rmax), rmax};
+    r.clear();
+    weights.clear();
+    for (int s = 0; s < 2; ++s) {
+        const double length = ends[s+1] - ends[s];
+        if (length <= 0.)
+            continue;
+        const int panels = (int) ceil(length / panel_width);
+        const double h = length / panels;
+        for (int p = 0; p < panels; ++p) {
+            for (int k = 0; k < order; ++k) {
+                r.push_back(ends[s] + (p + nodes[k]) * h);
+                weights.push_back(rule_weights[k] * h);
+            }
+        }
+    }
+
+    gsl_integration_fixed_free(rule_ptr);
+}
+
+//************************************************************
+
+//******************** reconstruct_wavefunctions ********************
+//
+// The radial functions u(r) = sum_j c_j u_j(r) of the point's
+//  eigenstates at the grid points r, as the rows of the nstates x
+//  r.size() matrix pointed to by wf_ptr (divide by r for the
+//  wavefunction).
+//   * The basis is tabulated once on the grid, B_jk = u_j(r_k), so
+//      that all of them are one matrix product, wf = C^T B, with the
+//      eigenvectors C as columns.
+//
+//*************************************************************
+void reconstruct_wavefunctions(const sweep_point *point_ptr, const vector<double> &r,
+                               gsl_matrix *wf_ptr)
+{
+    const int l = point_ptr->ho_parameters.l;
+    const int dimension = point_ptr->dimension;
+    const int npoints = r.size();
+
+    gsl_matrix *basis_ptr = gsl_matrix_alloc(dimension, npoints);
+    ho_radial_grid(dimension, l, point_ptr->ho_parameters.b_ho, npoints, r.data(),
+                   basis_ptr->data, basis_ptr->tda);
+
+    gsl_blas_dgemm(CblasTrans, CblasNoTrans, 1.0, point_ptr->Eigvec_ptr, basis_ptr, 0.0, wf_ptr);
+
+    gsl_matrix_free(basis_ptr);
+}
+
+//************************************************************
+
+// Print every element of H, row by row
+void print_hamiltonian(const gsl_matrix *Hmat_ptr) {
+    for (size_t i = 0; i < Hmat_ptr->size1; ++i) {
+        for (size_t j = 0; j < Hmat_ptr->size2; ++j) {
+            cout << "i = " << i << ", j = " << j
+                 << ", Hij = " << gsl_matrix_get(Hmat_ptr, i, j) << endl;
+        }
+    }
+}
+
+//************************************************************
+
+//********************** integration_workspace **********************
+//
+// A gsl_integration_workspace that is freed with its owner.  Hij
+//  keeps one per thread (thread_local), so the threads assembling H
+//  never share one and none is allocated per matrix element.
+//
+//*************************************************************
+struct integration_workspace
+{
+  gsl_integration_workspace *work_ptr;
+
+  explicit integration_workspace(size_t limit)
+    : work_ptr(gsl_integration_workspace_alloc(limit)) {}
+  ~integration_workspace() { gsl_integration_workspace_free(work_ptr); }
+
+  integration_workspace(const integration_workspace &) = delete;
+  integration_workspace &operator=(const integration_workspace &) = delete;
+};
+
 //************************************************************
 
 //************************** Hij ***************************
@@ -293,18 +1309,22 @@ double coulomb_wf_exact(int n, int l, double r, double mass) {
 //  in a Harmonic oscillator basis.  This routine just passes
 //  the integrand Hij_integrand to a GSL integration routine
 //  (gsl_integration_qagiu) that integrates it over r from 0
-//  to infinity
+//  to infinity, to within abs_error or rel_error, and leaves its
+//  error estimate in *error_ptr and its status in *status_ptr
+//  (GSL_SUCCESS, or e.g. GSL_EROUND or GSL_EMAXITER if the tolerance
+//  couldn't be reached, with the result and estimate still usable)
 //
-// Take l=0 only for now
+// The basis and the centrifugal term are those of ho_parameters.l
 //
 //*************************************************************
-double Hij(hij_parameters ho_parameters) {
-  gsl_integration_workspace *work = gsl_integration_workspace_alloc(1000);
+double Hij(hij_parameters ho_parameters, double abs_error, double rel_error,
+           double *error_ptr, int *status_ptr)
+{
+  const size_t limit = 1000;	// subintervals in the workspace
+  thread_local integration_workspace work(limit);
   gsl_function F_integrand;
 
   double lower_limit = 0.;	// start integral from 0 (to infinity)
-  double abs_error = 1.0e-8;	// to avoid round-off problems
-  double rel_error = 1.0e-8;	// the result will usually be much better
   double result = 0.;		// the result from the integration
   double error = 0.;		// the estimated error from the integration
 
@@ -317,9 +1337,9 @@ double Hij(hij_parameters ho_parameters) {
   F_integrand.params = params_ptr;
 
   // carry out the integral over r from 0 to infinity
-  gsl_integration_qagiu(&F_integrand, lower_limit,
-                        abs_error, rel_error, 1000, work, &result, &error);
-  // eventually we should do something with the error estimate
+  *status_ptr = gsl_integration_qagiu(&F_integrand, lower_limit, abs_error, rel_error,
+                                      limit, work.work_ptr, &result, &error);
+  *error_ptr = error;		// for the eigenvalue error bound
 
   return result;		// send back the result of the integration
 }
@@ -336,12 +1356,10 @@ double Hij(hij_parameters ho_parameters) {
 //
 //************************************************************
 double Hij_integrand (double x, void *params_ptr) {
-  potential_parameters potl_params;	// parameters to pass to potential
-  double Zesq;			// Ze^2 for Coulomb potential
-  double R, V0;			// radius and depth of square well
-  int potential_index;		// index 1,2,... for potental
+  const potential_entry *potential;	// which potential
+  potential_parameters *potl_params_ptr;	// and its parameters
 
-  int l = 0;			// orbital angular momentum
+  int l;			// orbital angular momentum
   int n_i, n_j;			// principal quantum number (1,2,...)
   double mass, b_ho;		// local ho parameters
   double hbar = 1.;		// units with hbar = 1
@@ -354,13 +1372,15 @@ double Hij_integrand (double x, void *params_ptr) {
   double fp, f, fm, deriv2;
   */
 
+  l = ((hij_parameters *) params_ptr)->l;
   n_i = ((hij_parameters *) params_ptr)->i + 1;	// n starts at 1
   n_j = ((hij_parameters *) params_ptr)->j + 1;
   mass = ((hij_parameters *) params_ptr)->mass;
   b_ho = ((hij_parameters *) params_ptr)->b_ho;
   omega = hbar / (mass * b_ho * b_ho);	// definition of omega
   ho_pot = (1. / 2.) * mass * (omega * omega) * (x * x);	// ho pot'l
-  potential_index = ((hij_parameters *) params_ptr)->potential_index;
+  potential = ((hij_parameters *) params_ptr)->potential;
+  potl_params_ptr = &((hij_parameters *) params_ptr)->potl_params;
 
   // debugging code to calculate 2nd derivative by hand
   /*
@@ -370,32 +1390,15 @@ double Hij_integrand (double x, void *params_ptr) {
   deriv2 = -((fp - f) - (f - fm)) / (h * h) / (2. * mass);
   */
 
-  // set up the potential according to potential index
-  switch (potential_index) {
-    case 1:			// coulomb
-      Zesq = 1.;
-      potl_params.param1 = Zesq;
-      return ho_radial(n_i, l, b_ho, x)
-             * (ho_eigenvalue(n_j, l, b_ho, mass) - ho_pot
-                + V_coulomb(x, &potl_params))
-             * ho_radial(n_j, l, b_ho, x);
-      break;
-    case 2:			// square well
-      R = 1.;
-      V0 = 50.;
-      potl_params.param1 = V0;
-      potl_params.param2 = R;
-      return ho_radial(n_i, l, b_ho, x)
-	         * (ho_eigenvalue(n_j, l, b_ho, mass) - ho_pot
-                + V_square_well(x, &potl_params))
-             * ho_radial(n_j, l, b_ho, x);
-      break;
-    default:
-      cout << "Shouldn't get here!\n";
-      return (1);
-      break;
-  }
+  // all u_n up to the larger of n_i, n_j come from one recurrence
+  thread_local vector<double> u;
+  u.resize(max(n_i, n_j));
+  ho_radial_all(u.size(), l, b_ho, x, u.data());
 
+  return u[n_i - 1]
+         * (ho_eigenvalue(n_j, l, b_ho, mass) - ho_pot
+            + potential->V(x, potl_params_ptr))
+         * u[n_j - 1];
 
   // debugging code to use crude 2nd derivative
   // return (ho_radial (n_i, l, b_ho, x)
@@ -406,6 +1409,41 @@ double Hij_integrand (double x, void *params_ptr) {
 
 //************************** Potentials *************************
 
+//************************** find_potential ***************************
+//
+// The entry of potential_table called name, or numbered name
+//  (from 1); NULL if there is none.
+//
+//**************************************************************
+const potential_entry *find_potential(const string &name) {
+  for (int i = 0; i < npotentials; ++i) {
+      if (name == potential_table[i].name || name == to_string(i+1))
+          return &potential_table[i];
+  }
+  return NULL;
+}
+
+//************************** V_breakpoint ***************************
+//
+// The r where the potential of ho_parameters jumps, or 0 if it is
+//  smooth.
+//
+//**************************************************************
+double V_breakpoint(const hij_parameters *ho_parameters_ptr) {
+  const potential_parameters &potl_params = ho_parameters_ptr->potl_params;
+
+  switch (ho_parameters_ptr->potential->breakpoint_param) {
+    case 1:
+      return potl_params.param1;
+    case 2:
+      return potl_params.param2;
+    case 3:
+      return potl_params.param3;
+    default:
+      return 0.;
+  }
+}
+
 //************************** V_coulomb ***************************
 //
 // Coulomb potential with charge Z:  Ze^2/r
@@ -459,3 +1497,54 @@ V_morse (double r, potential_parameters * potl_params_ptr)
 }
 
 //**************************************************************
+
+//************************** V_user ***************************
+//
+// Potential read from a file by read_user_potential, interpolated
+//  linearly and constant beyond the ends of the table, times param1
+//
+//**************************************************************
+double V_user(double r, potential_parameters * potl_params_ptr) {
+  double scale = potl_params_ptr->param1;
+  const user_potential *table_ptr = potl_params_ptr->user_ptr;
+  const vector<double> &rs = table_ptr->r;
+  const vector<double> &Vs = table_ptr->V;
+
+  if (r <= rs.front())
+      return scale * Vs.front();
+  if (r >= rs.back())
+      return scale * Vs.back();
+
+  const size_t k = upper_bound(rs.begin(), rs.end(), r) - rs.begin();
+  const double t = (r - rs[k-1]) / (rs[k] - rs[k-1]);
+  return scale * ((1. - t) * Vs[k-1] + t * Vs[k]);
+}
+
+//************************** read_user_potential ***************************
+//
+// Read a potential as two columns, r and V(r), in increasing r; lines
+//  starting with # are comments.  Returns false if the file can't be
+//  read or the r are not increasing.
+//
+//**************************************************************
+bool read_user_potential(const string &filename, user_potential *table_ptr) {
+  ifstream potl_in(filename);
+  string line;
+
+  table_ptr->r.clear();
+  table_ptr->V.clear();
+  while (getline(potl_in, line)) {
+      istringstream fields(line);
+      double r, V;
+      if (line.empty() || line[0] == '#' || !(fields >> r >> V))
+          continue;
+      if (!table_ptr->r.empty() && r <= table_ptr->r.back())
+          return false;
+      table_ptr->r.push_back(r);
+      table_ptr->V.push_back(V);
+  }
+
+  return !table_ptr->r.empty();
+}
+
+//**************************************************************
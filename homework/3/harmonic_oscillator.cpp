@@ -6,6 +6,11 @@
 //
 //  Revision history:
 //      01/24/04  original version, translated from harmonic_oscillator.c
+//      10/18/26  ho_radial_all and ho_radial_grid for all n at once
+//      10/18/26  norm in log space and cached; scaled recurrence so
+//                large n stay finite
+//      10/18/26  the recurrences take their normalization from the
+//                cache too, and share one step and rescale
 //
 //  Notes:
 //   * The potential is V(r) = (1/2)m \omega^2 r^2.
@@ -19,6 +24,12 @@
 //   * Conventions NOT the same as Fetter and Walecka section 57.
 //       * Laguerre polynomials not normalized with cube
 //   * Normalization is: \int_0^\infty dr [u_{nl}(r)]^2 = 1
+//   * ho_radial_all and ho_radial_grid give u_{nl} for n = 1..nmax
+//      together from a recurrence for the normalized Laguerre
+//      polynomials, which needs no factorials or gamma functions and
+//      only one exponential per r.  It is rescaled as it goes, so it
+//      works for n in the thousands, where L^{l+1/2}_{n-1} alone
+//      overflows a double.
 //   * Uses gsl library; compile and link with:
 //         g++ -c harmonic_oscillator.c
 //         g++ -o ... harmonic_oscillator.o -lgsl -lgslcblas -lm
@@ -30,6 +41,7 @@
 
 // include files
 #include <cmath>
+#include <vector>
 
 #include <gsl/gsl_math.h>
 #include <gsl/gsl_sf_gamma.h>
@@ -38,7 +50,23 @@
 
 // function prototypes 
 double ho_radial (int n, int l, double b, double r);
+void ho_radial_all (int nmax, int l, double b, double r, double *u);
+void ho_radial_grid (int nmax, int l, double b, int npoints, const double *r,
+		     double *u, int stride);
 double norm (int n, int l, double b);
+double log_norm (int n, int l, double b);
+double cached_log_norm (int n, int l, double b);
+
+// the scaled recurrences divide by this when they exceed it
+const double rescale_limit = 1.e100;
+
+// the recurrence of ho_radial_all and ho_radial_grid, one step at a time
+inline void recurrence_coefficients (int k, double a, double *shift,
+				     double *c_prev, double *c_next);
+inline void recurrence_step (double shift, double c_prev, double c_next,
+			     double qsq, double *prev_ptr, double *cur_ptr);
+inline void recurrence_rescale (double *prev_ptr, double *cur_ptr,
+				double *log_scale_ptr, double *scale_ptr);
 double ho_eigenvalue (int n, int l, double b, double m);
 
 //************************************************************************ 
@@ -76,19 +104,201 @@ ho_radial (int n, int l, double b, double r)
     * gsl_sf_laguerre_n ((n - 1), a, qsq);
 }
 
+//************************************************************************ 
+//  
+//     Calculate the normalized harmonic oscillator radial functions
+//      for n = 1..nmax at position r, into u[0..nmax-1]
+//
+//  * With k = n-1, a = l+1/2 and x = q^2, the normalized Laguerre
+//     polynomials \hat L_k = sqrt(k!/\Gamma(k+a+1)) L^a_k satisfy
+//       sqrt((k+1)(k+a+1)) \hat L_{k+1}
+//          = (2k+1+a-x) \hat L_k - sqrt(k(k+a)) \hat L_{k-1},
+//     and u_{nl} = sqrt(2/b) q^{l+1} e^{-q^2/2} \hat L_{n-1}(q^2), so
+//     the same recurrence holds for u itself.
+//  * Stable upwards in k, like the unnormalized one gsl uses.
+//  * The normalization of u_1 comes from the table of cached_log_norm,
+//     so no factorials or gamma functions are evaluated per r.
+//
+//*************************************************************************
+void
+ho_radial_all (int nmax, int l, double b, double r, double *u)
+{
+  double a = (double) l + 1. / 2.;
+  double q = r / b;
+  double qsq = q * q;
+  // u_n = scale * \hat L_{n-1} / \hat L_0, with scale kept as a log
+  double log_scale = cached_log_norm (1, l, b) + (l + 1) * log (q) - qsq / 2.;
+  double scale = exp (log_scale);
+  double prev = 0., cur = 1.;
+
+  if (nmax < 1)
+    return;
+  u[0] = scale;
+
+  for (int k = 0; k + 1 < nmax; k++)
+    {
+      double shift, c_prev, c_next;
+
+      recurrence_coefficients (k, a, &shift, &c_prev, &c_next);
+      recurrence_step (shift, c_prev, c_next, qsq, &prev, &cur);
+      recurrence_rescale (&prev, &cur, &log_scale, &scale);
+      u[k + 1] = cur * scale;
+    }
+}
+
+//************************************************************************ 
+//  
+//     Same as ho_radial_all, at each of r[0..npoints-1]
+//
+//  * u_{nl}(r[p]) goes to u[(n-1)*stride + p], so row n-1 of a matrix
+//     with leading dimension stride holds u_{nl} on the grid.
+//  * The loops over the grid are independent and vectorize.
+//
+//*************************************************************************
+void
+ho_radial_grid (int nmax, int l, double b, int npoints, const double *r,
+		double *u, int stride)
+{
+  double a = (double) l + 1. / 2.;
+  double log_u0_norm = cached_log_norm (1, l, b);
+  std::vector<double> qsq (npoints), log_scale (npoints), scale (npoints);
+  std::vector<double> prev (npoints, 0.), cur (npoints, 1.);
+
+  if (nmax < 1)
+    return;
+
+  for (int p = 0; p < npoints; p++)
+    {
+      double q = r[p] / b;
+      qsq[p] = q * q;
+      log_scale[p] = log_u0_norm + (l + 1) * log (q) - qsq[p] / 2.;
+      scale[p] = exp (log_scale[p]);
+      u[p] = scale[p];
+    }
+
+  for (int k = 0; k + 1 < nmax; k++)
+    {
+      double shift, c_prev, c_next;
+      double *u_next = u + (k + 1) * stride;
+
+      recurrence_coefficients (k, a, &shift, &c_prev, &c_next);
+#ifdef OMP
+#pragma omp simd
+#endif
+      for (int p = 0; p < npoints; p++)
+	recurrence_step (shift, c_prev, c_next, qsq[p], &prev[p], &cur[p]);
+      for (int p = 0; p < npoints; p++)
+	recurrence_rescale (&prev[p], &cur[p], &log_scale[p], &scale[p]);
+#ifdef OMP
+#pragma omp simd
+#endif
+      for (int p = 0; p < npoints; p++)
+	u_next[p] = cur[p] * scale[p];
+    }
+}
+
+//************************************************************************ 
+//  
+//     The pieces of the scaled recurrence shared by ho_radial_all and
+//      ho_radial_grid
+//
+//  * recurrence_coefficients: for step k -> k+1,
+//     \hat L_{k+1} = ((shift - x) \hat L_k - c_prev \hat L_{k-1}) c_next
+//  * recurrence_step: (prev, cur) = (\hat L_{k-1}, \hat L_k) becomes
+//     (\hat L_k, \hat L_{k+1}), both relative to the current scale
+//  * recurrence_rescale: moves a factor rescale_limit from (prev, cur)
+//     into scale once cur exceeds it
+//
+//*************************************************************************
+inline void
+recurrence_coefficients (int k, double a, double *shift, double *c_prev,
+			 double *c_next)
+{
+  *shift = 2. * k + 1. + a;
+  *c_prev = sqrt (k * (k + a));
+  *c_next = 1. / sqrt ((k + 1.) * (k + a + 1.));
+}
+
+inline void
+recurrence_step (double shift, double c_prev, double c_next, double qsq,
+		 double *prev_ptr, double *cur_ptr)
+{
+  double next = ((shift - qsq) * *cur_ptr - c_prev * *prev_ptr) * c_next;
+
+  *prev_ptr = *cur_ptr;
+  *cur_ptr = next;
+}
+
+inline void
+recurrence_rescale (double *prev_ptr, double *cur_ptr, double *log_scale_ptr,
+		    double *scale_ptr)
+{
+  if (fabs (*cur_ptr) > rescale_limit)
+    {
+      *prev_ptr /= rescale_limit;
+      *cur_ptr /= rescale_limit;
+      *log_scale_ptr += log (rescale_limit);
+      *scale_ptr = exp (*log_scale_ptr);
+    }
+}
+
 //************************************************************************ 
 //  
 //     Normalization factor for a harmonic oscillator radial function 
 //
 //  * N_{nl} = 2(n-1)!/[b \Gamma(n+l+1/2)]
 //  * verified by checking against Mathematica for different n,l,b
+//  * The factorial and gamma function overflow for n > 170, but N_{nl}
+//     itself only falls off like n^{-(l+1/2)/2}, so it is computed from
+//     log_norm.
 //
 //*************************************************************************
 double
 norm (int n, int l, double b)
+{
+  return exp (cached_log_norm (n, l, b));
+}
+
+//************************************************************************ 
+//  
+//     Logarithm of the normalization factor N_{nl}
+//
+//*************************************************************************
+double
+log_norm (int n, int l, double b)
 {
   double arg = (double) n + (double) l + 1. / 2.;
 
-  return sqrt (2. * gsl_sf_fact ((unsigned) (n - 1)) /
-	       (b * gsl_sf_gamma (arg)));
+  return (M_LN2 + gsl_sf_lnfact ((unsigned) (n - 1)) - log (b)
+	  - gsl_sf_lngamma (arg)) / 2.;
+}
+
+//************************************************************************ 
+//  
+//     log_norm from a table
+//
+//  * Cached per thread for the last (l, b) asked for, indexed by n;
+//     the table grows as larger n are needed.  This is what norm,
+//     ho_radial_all and ho_radial_grid use, so the factorial and
+//     gamma function are evaluated once per (n, l, b) rather than on
+//     every call.
+//
+//*************************************************************************
+double
+cached_log_norm (int n, int l, double b)
+{
+  thread_local int table_l = -1;
+  thread_local double table_b = 0.;
+  thread_local std::vector<double> table;
+
+  if (l != table_l || b != table_b)
+    {
+      table.clear ();
+      table_l = l;
+      table_b = b;
+    }
+  while ((int) table.size () < n)
+    table.push_back (log_norm ((int) table.size () + 1, l, b));
+
+  return table[n - 1];
 }
@@ -0,0 +1,228 @@
+//  file: partial_eigen.cpp
+//
+//  Lowest few eigenvalues and eigenvectors of a real symmetric matrix,
+//   without the cost of the full eigenvector set
+//
+//  Programmer:  Nicholas Todoroff todorof3@msu.edu
+//
+//  Revision history:
+//      10/18/26  original version
+//
+//  Notes:
+//   * Same steps as LAPACK's dsyevx with an index range:
+//       * reduce H to tridiagonal T = Q^T H Q with Householder
+//          reflections (gsl_linalg_symmtd_decomp), ~4/3 N^3
+//       * find the k lowest eigenvalues of T by bisection on Sturm
+//          counts, O(kN)
+//       * their eigenvectors by inverse iteration on T, O(kN)
+//       * transform those back with the reflections, x = Q y, O(kN^2)
+//   * gsl_eigen_symmv instead accumulates all N eigenvectors through
+//      the implicit QR sweeps as well, several times the work of the
+//      reduction alone.
+//   * Krylov methods (Lanczos) would avoid the O(N^3) reduction, but
+//      in the oscillator basis the spectrum of H is wide (~N hbar omega)
+//      while the low Coulomb states are bunched near 0, and Lanczos
+//      needed on the order of N steps to resolve them.
+//
+//*****************************************************************
+
+// include files
+#include <cmath>
+#include <cfloat>
+#include <vector>
+#include <algorithm>
+using namespace std;
+
+#include <gsl/gsl_linalg.h>	// tridiagonal reduction, reflections
+
+// function prototypes
+void eigen_lowest(gsl_matrix *Hmat_ptr, gsl_vector *Eigval_ptr, gsl_matrix *Eigvec_ptr);
+int sturm_count(const vector<double> &diag, const vector<double> &offdiag, double x);
+void tridiagonal_eigenvector(const vector<double> &diag, const vector<double> &offdiag,
+                             double lambda, double Tnorm, vector<double> &y);
+
+// to square numbers
+template<class T> inline T sqr(T x) { return x*x; }
+
+//************************** eigen_lowest ***************************
+//
+// Find the Eigval_ptr->size lowest eigenvalues of the symmetric
+//  matrix pointed to by Hmat_ptr, in ascending order, and their
+//  eigenvectors as the columns of Eigvec_ptr (dimension x size).
+//  Like gsl_eigen_symmv, only the lower triangle of H is used and H
+//  is destroyed in the process.
+//
+//*************************************************************
+void eigen_lowest(gsl_matrix *Hmat_ptr, gsl_vector *Eigval_ptr, gsl_matrix *Eigvec_ptr) {
+  const int dimension = Hmat_ptr->size1;
+  const int nstates = Eigval_ptr->size;
+
+  // H -> T, with the reflections left in the lower triangle of H
+  vector<double> diag(dimension), offdiag(max(dimension - 1, 1)), tau_data(offdiag.size());
+  gsl_vector_view diag_view = gsl_vector_view_array(diag.data(), dimension);
+  if (dimension > 1) {
+    gsl_vector_view offdiag_view = gsl_vector_view_array(offdiag.data(), dimension - 1);
+    gsl_vector_view tau = gsl_vector_view_array(tau_data.data(), dimension - 1);
+    gsl_linalg_symmtd_decomp(Hmat_ptr, &tau.vector);
+    gsl_linalg_symmtd_unpack_T(Hmat_ptr, &diag_view.vector, &offdiag_view.vector);
+  }
+  else
+    diag[0] = gsl_matrix_get(Hmat_ptr, 0, 0);
+  offdiag.resize(dimension - 1);
+
+  // Gershgorin bounds on the spectrum of T
+  double lower = diag[0], upper = diag[0];
+  for (int i = 0; i < dimension; ++i) {
+    const double radius = (i > 0 ? fabs(offdiag[i-1]) : 0.)
+                          + (i+1 < dimension ? fabs(offdiag[i]) : 0.);
+    lower = min(lower, diag[i] - radius);
+    upper = max(upper, diag[i] + radius);
+  }
+  const double Tnorm = max(fabs(lower), fabs(upper));
+  lower -= 2. * DBL_EPSILON * Tnorm;
+  upper += 2. * DBL_EPSILON * Tnorm;
+
+  vector<double> Y(nstates * dimension);	// eigenvectors of T as rows
+  for (int k = 0; k < nstates; ++k) {
+    // Bisect for the value with exactly k eigenvalues below it
+    double a = lower, b = upper;
+    while (b - a > 2. * DBL_EPSILON * max(fabs(a), fabs(b)) + DBL_MIN) {
+      const double mid = a + (b - a) / 2.;
+      if (mid <= a || mid >= b)
+        break;
+      if (sturm_count(diag, offdiag, mid) > k)
+        b = mid;
+      else
+        a = mid;
+    }
+    const double lambda = a + (b - a) / 2.;
+    gsl_vector_set(Eigval_ptr, k, lambda);
+
+    vector<double> y(dimension);
+    tridiagonal_eigenvector(diag, offdiag, lambda, Tnorm, y);
+
+    // Close eigenvalues give nearly parallel inverse iterates: keep
+    //  them orthogonal to the ones already found in the cluster
+    for (int j = k - 1; j >= 0; --j) {
+      if (lambda - gsl_vector_get(Eigval_ptr, j) > 1.e-3 * Tnorm)
+        break;
+      const double *const y_j = &Y[j * dimension];
+      double overlap = 0.;
+      for (int i = 0; i < dimension; ++i)
+        overlap += y_j[i] * y[i];
+      for (int i = 0; i < dimension; ++i)
+        y[i] -= overlap * y_j[i];
+    }
+    double y_norm = 0.;
+    for (int i = 0; i < dimension; ++i)
+      y_norm += y[i] * y[i];
+    y_norm = sqrt(y_norm);
+    for (int i = 0; i < dimension; ++i)
+      Y[k * dimension + i] = y[i] / y_norm;
+
+    // x = Q y = H_0 H_1 ... H_{N-3} y, as in gsl_linalg_symmtd_unpack
+    gsl_vector_view x = gsl_matrix_column(Eigvec_ptr, k);
+    for (int i = 0; i < dimension; ++i)
+      gsl_vector_set(&x.vector, i, Y[k * dimension + i]);
+    for (int i = dimension - 3; i >= 0; --i) {
+      gsl_vector_view c = gsl_matrix_column(Hmat_ptr, i);
+      gsl_vector_view h = gsl_vector_subvector(&c.vector, i + 1, dimension - (i + 1));
+      gsl_vector_view x_i = gsl_vector_subvector(&x.vector, i + 1, dimension - (i + 1));
+      gsl_linalg_householder_hv(tau_data[i], &h.vector, &x_i.vector);
+    }
+  }
+}
+
+//************************************************************
+
+//************************** sturm_count ***************************
+//
+// Number of eigenvalues of the symmetric tridiagonal matrix (diag,
+//  offdiag) below x: the number of negative pivots of T - x.
+//
+//*************************************************************
+int sturm_count(const vector<double> &diag, const vector<double> &offdiag, double x) {
+  int count = 0;
+  double pivot = 1.;
+  for (size_t i = 0; i < diag.size(); ++i) {
+    pivot = diag[i] - x - (i > 0 ? sqr(offdiag[i-1]) / pivot : 0.);
+    if (pivot == 0.)
+      pivot = -DBL_EPSILON * (fabs(diag[i]) + fabs(x) + DBL_MIN);
+    if (pivot < 0.)
+      ++count;
+  }
+  return count;
+}
+
+//************************************************************
+
+//******************** tridiagonal_eigenvector ********************
+//
+// Eigenvector y (not normalized) of the symmetric tridiagonal matrix
+//  (diag, offdiag) for the eigenvalue lambda, by two steps of inverse
+//  iteration: solve (T - lambda) y_new = y.
+//   * T - lambda is factored by Gaussian elimination with row
+//      interchanges, which fills in a second superdiagonal; zero
+//      pivots (lambda is an eigenvalue) become eps*Tnorm.
+//
+//*************************************************************
+void tridiagonal_eigenvector(const vector<double> &diag, const vector<double> &offdiag,
+                             double lambda, double Tnorm, vector<double> &y)
+{
+  const int n = diag.size();
+  const double tiny = DBL_EPSILON * max(Tnorm, DBL_MIN);
+  vector<double> u0(n), u1(n, 0.), u2(n, 0.), multiplier(n, 0.);
+  vector<bool> swapped(n, false);
+
+  for (int i = 0; i < n; ++i) {
+    u0[i] = diag[i] - lambda;
+    if (i+1 < n)
+      u1[i] = offdiag[i];
+  }
+  for (int i = 0; i+1 < n; ++i) {
+    const double sub = offdiag[i];	// element (i+1, i)
+    if (fabs(u0[i]) >= fabs(sub)) {
+      if (u0[i] == 0.)
+        u0[i] = tiny;
+      multiplier[i] = sub / u0[i];
+      u0[i+1] -= multiplier[i] * u1[i];
+    }
+    else {
+      // rows i and i+1 trade places
+      const double row0 = u0[i], row1 = u1[i];
+      swapped[i] = true;
+      multiplier[i] = row0 / sub;
+      u0[i] = sub;
+      u1[i] = u0[i+1];
+      u2[i] = i+2 < n ? u1[i+1] : 0.;
+      u0[i+1] = row1 - multiplier[i] * u1[i];
+      if (i+2 < n)
+        u1[i+1] = -multiplier[i] * u2[i];
+    }
+  }
+  if (u0[n-1] == 0.)
+    u0[n-1] = tiny;
+
+  fill(y.begin(), y.end(), 1.);
+  for (int iteration = 0; iteration < 2; ++iteration) {
+    for (int i = 0; i+1 < n; ++i) {
+      if (swapped[i])
+        swap(y[i], y[i+1]);
+      y[i+1] -= multiplier[i] * y[i];
+    }
+    double y_max = 0.;
+    for (int i = n - 1; i >= 0; --i) {
+      double sum = y[i];
+      if (i+1 < n)
+        sum -= u1[i] * y[i+1];
+      if (i+2 < n)
+        sum -= u2[i] * y[i+2];
+      y[i] = sum / u0[i];
+      y_max = max(y_max, fabs(y[i]));
+    }
+    for (int i = 0; i < n; ++i)
+      y[i] /= y_max;
+  }
+}
+
+//************************************************************